@@ -1,10 +1,33 @@
 #include "DSCore.h"
+#include <algorithm>
 #include <opencv2\opencv.hpp>
 
-DSCore::DSCore(){}
+DSCore::DSCore(){
+	backend = CUDA_BACKEND;
+	threads = 1;
+	options = DEFAULT_OPTIONS;
+	min_disparity = 0;
+	subpixel_bits = 8;
+	outlier_count = -1;
+	uniqueness_ratio = 1.0f;
+	pyramid_factor = 2;
+	pyramid_radius = 4;
+	temporal_radius = 3;
+	temporal_threshold = 12;
+	temporal_refresh = 30;
+	temporal_age = -1;
+	range_margin = 8;
+	range_refresh = 30;
+	range_age = 0;
+	change_tile = 32;
+	change_threshold = 4;
+}
 
 DSCore::~DSCore(){
-	
+
+	//Host buffers free themselves
+	if (backend == HOST_BACKEND) return;
+
 	//Free textures
 	cudaDestroyTextureObject(left_tex);
 	cudaDestroyTextureObject(right_tex);
@@ -30,11 +53,45 @@ DSCore::~DSCore(){
 	cudaFree(d_final_disp);
 }
 
-void DSCore::setup(int width, int height, int disparities){
+void DSCore::setup(int width, int height, int disparities, core_backend backend, int threads, int options){
+	setup(width, height, 0, disparities, backend, threads, options);
+}
+
+void DSCore::setup(int width, int height, int min_disparity, int disparities, core_backend backend, int threads, int options){
 
 	//Initialize variables
 	this->width = width;
 	this->height = height;
+	this->backend = backend;
+	this->threads = threads > 0 ? threads : host_default_threads();
+	//Change detection matches crops of the frame, the frame to frame state of these would not carry over
+	this->options = (options & CHANGE_DETECTION) ? options & ~(TEMPORAL_PRIOR | ADAPTIVE_RANGE) : options;
+
+	//Disparities are stored as unsigned 16-bit fixed point, at least their integer part has to fit
+	min_disparity = std::min(std::max(min_disparity, 0), 65535);
+	disparities = std::min(std::max(disparities, 1), 65536 - min_disparity);
+
+	if (backend == HOST_BACKEND){
+		//Integer maps hold disparities up to 255
+		if (options & INTEGER_DISPARITY){
+			min_disparity = std::min(min_disparity, 255);
+			disparities = std::min(disparities, 256 - min_disparity);
+		}
+
+		this->min_disparity = min_disparity;
+		this->disparities = disparities;
+		this->subpixel_bits = (options & INTEGER_DISPARITY) ? 0 : host_subpixel_bits(min_disparity, disparities);
+		active_min = min_disparity;
+		active_disparities = disparities;
+		range_age = 0;
+		host_setup();
+		return;
+	}
+
+	//The device matches from zero and packs the winner into 8 bits, so its range ends at 256 with 8.8 output
+	this->min_disparity = 0;
+	this->subpixel_bits = 8;
+	disparities += min_disparity;
 
 	if (disparities <= 64){
 		this->disparities = 64;
@@ -55,8 +112,8 @@ void DSCore::setup(int width, int height, int disparities){
 	cudaMalloc(&d_left_census, width * height * sizeof(unsigned long long int));
 	cudaMalloc(&d_right_census, width * height * sizeof(unsigned long long int));
 	cudaMalloc(&d_arm_vol, width * height * sizeof(uchar4));
-	cudaMalloc(&d_cost_vol_temp_a, width * height * sizeof(float) * (disparities));
-	cudaMalloc(&d_cost_vol_temp_b, width * height * sizeof(float) * (disparities));
+	cudaMalloc(&d_cost_vol_temp_a, width * height * sizeof(float) * (this->disparities));
+	cudaMalloc(&d_cost_vol_temp_b, width * height * sizeof(float) * (this->disparities));
 	cudaMalloc(&d_left_disp, width * height * sizeof(unsigned short));
 	cudaMalloc(&d_right_disp, width * height * sizeof(unsigned short));
 	cudaMalloc(&d_final_disp, width * height * sizeof(unsigned short));
@@ -125,7 +182,92 @@ void DSCore::setup(int width, int height, int disparities){
 
 }
 
+void DSCore::host_setup(){
+
+	//A single pass needs no right-reference cross, volume or map
+	bool pair = !(options & SINGLE_PASS);
+
+	//Allocate host memory
+	h_left.resize(width * height);
+	h_right.resize(width * height);
+	if (options & COLOR_ARMS){
+		h_left_color.resize(width * height * 3);
+		if (pair) h_right_color.resize(width * height * 3);
+	}
+	h_left_census.resize(width * height);
+	h_right_census.resize(width * height);
+	h_arm_vol.resize(width * height);
+	if (pair) h_right_arm_vol.resize(width * height);
+
+	//Streaming sizes its band scratch per call, it depends on max_arm_length, and so does the pyramid its volumes, they
+	//depend on the pyramid settings. Wide ranges are matched a chunk at a time
+	if (!(options & (STREAMING_VOLUME | PYRAMID_MATCHING))){
+		size_t volume_size = (size_t)width * height * host_disparity_chunk(disparities);
+
+		if (options & FIXED_POINT_COST){
+			h_fixed_cost_vol_a.resize(volume_size);
+			if (pair) h_fixed_cost_vol_b.resize(volume_size);
+		}
+		else{
+			h_cost_vol_temp_a.resize(volume_size);
+			if (pair) h_cost_vol_temp_b.resize(volume_size);
+		}
+	}
+
+	if (options & INTEGER_DISPARITY){
+		h_left_int_disp.resize(width * height);
+		if (pair) h_right_int_disp.resize(width * height);
+		h_final_int_disp.resize(width * height);
+		h_int_disp_temp.resize(width * height);
+	}
+	else{
+		h_left_disp.resize(width * height);
+		if (pair) h_right_disp.resize(width * height);
+		h_final_disp.resize(width * height);
+		h_disp_temp.resize(width * height);
+	}
+	if (options & CONFIDENCE_MAP) h_confidence.resize(width * height);
+	h_outliers.resize(width * height);
+}
+
+void *DSCore::host_data(core_data data, size_t &size){
+	switch (data)
+	{
+	case DSCore::LEFT_DATA: size = h_left.size() * sizeof(unsigned char); return h_left.data();
+	case DSCore::RIGHT_DATA: size = h_right.size() * sizeof(unsigned char); return h_right.data();
+	case DSCore::LEFT_CENSUS_DATA: size = h_left_census.size() * sizeof(unsigned long long int); return h_left_census.data();
+	case DSCore::RIGHT_CENSUS_DATA: size = h_right_census.size() * sizeof(unsigned long long int); return h_right_census.data();
+	case DSCore::ARM_DATA: size = h_arm_vol.size() * sizeof(uchar4); return h_arm_vol.data();
+	case DSCore::COSTA_DATA:
+		if (options & FIXED_POINT_COST){ size = h_fixed_cost_vol_a.size() * sizeof(unsigned int); return h_fixed_cost_vol_a.data(); }
+		size = h_cost_vol_temp_a.size() * sizeof(float); return h_cost_vol_temp_a.data();
+	case DSCore::COSTB_DATA:
+		if (options & FIXED_POINT_COST){ size = h_fixed_cost_vol_b.size() * sizeof(unsigned int); return h_fixed_cost_vol_b.data(); }
+		size = h_cost_vol_temp_b.size() * sizeof(float); return h_cost_vol_temp_b.data();
+	case DSCore::LEFT_DISP_DATA:
+		if (options & INTEGER_DISPARITY){ size = h_left_int_disp.size(); return h_left_int_disp.data(); }
+		size = h_left_disp.size() * sizeof(unsigned short); return h_left_disp.data();
+	case DSCore::RIGHT_DISP_DATA:
+		if (options & INTEGER_DISPARITY){ size = h_right_int_disp.size(); return h_right_int_disp.data(); }
+		size = h_right_disp.size() * sizeof(unsigned short); return h_right_disp.data();
+	case DSCore::FINAL_DISP_DATA:
+		if (options & INTEGER_DISPARITY){ size = h_final_int_disp.size(); return h_final_int_disp.data(); }
+		size = h_final_disp.size() * sizeof(unsigned short); return h_final_disp.data();
+	case DSCore::LEFT_COLOR_DATA: size = h_left_color.size() * sizeof(unsigned char); return h_left_color.data();
+	case DSCore::RIGHT_COLOR_DATA: size = h_right_color.size() * sizeof(unsigned char); return h_right_color.data();
+	case DSCore::CONFIDENCE_DATA: size = h_confidence.size() * sizeof(unsigned char); return h_confidence.data();
+	default: size = 0; return NULL;
+	}
+}
+
 void DSCore::copy_from_host_to_device(void *data_container, core_data data){
+	if (backend == HOST_BACKEND){
+		size_t size;
+		void *buffer = host_data(data, size);
+		if (buffer) memcpy(buffer, data_container, size);
+		return;
+	}
+
 	switch (data)
 	{
 	case DSCore::LEFT_DATA:
@@ -165,7 +307,124 @@ void DSCore::copy_from_host_to_device(void *data_container, core_data data){
 	}
 }
 
+//Zeroes the texels of an array_width x array_height array outside its top-left width x height block, from a zeroed
+//device buffer of array_width x array_height elements. A smaller map leaves the fetches past its edges no stale texels
+static void clear_array_margin(cudaArray *array, const void *zeros, size_t element_size, int width, int height, int array_width, int array_height){
+	size_t pitch = array_width * element_size;
+	if (width < array_width)
+		cudaMemcpy2DToArrayAsync(array, width * element_size, 0, zeros, pitch, (array_width - width) * element_size, height, cudaMemcpyDeviceToDevice);
+	if (height < array_height)
+		cudaMemcpy2DToArrayAsync(array, 0, height, zeros, pitch, pitch, array_height - height, cudaMemcpyDeviceToDevice);
+}
+
+void DSCore::copy_from_host_to_device(void *data_container, core_data data, int width, int height){
+	if (backend == HOST_BACKEND){
+		size_t size;
+		void *buffer = host_data(data, size);
+		if (buffer) memcpy(buffer, data_container, size / ((size_t)this->width * this->height) * width * height);
+		return;
+	}
+
+	//The frames also go to their arrays row by row, texture fetches address them by the full width. The rest of each
+	//array is zeroed from the frame buffer first
+	switch (data)
+	{
+	case DSCore::LEFT_DATA:
+		cudaMemset(d_left, 0, this->width * this->height * sizeof(unsigned char));
+		clear_array_margin(left_array, d_left, sizeof(unsigned char), width, height, this->width, this->height);
+		cudaMemcpy(d_left, data_container, width * height * sizeof(unsigned char), cudaMemcpyHostToDevice);
+		cudaMemcpy2DToArrayAsync(left_array, 0, 0, d_left, width * sizeof(unsigned char), width * sizeof(unsigned char), height, cudaMemcpyDeviceToDevice);
+		break;
+	case DSCore::RIGHT_DATA:
+		cudaMemset(d_right, 0, this->width * this->height * sizeof(unsigned char));
+		clear_array_margin(right_array, d_right, sizeof(unsigned char), width, height, this->width, this->height);
+		cudaMemcpy(d_right, data_container, width * height * sizeof(unsigned char), cudaMemcpyHostToDevice);
+		cudaMemcpy2DToArrayAsync(right_array, 0, 0, d_right, width * sizeof(unsigned char), width * sizeof(unsigned char), height, cudaMemcpyDeviceToDevice);
+		break;
+	default:
+		break;
+	}
+}
+
+void DSCore::copy_from_device_to_host(void *data_container, core_data data, int width, int height){
+	if (backend == HOST_BACKEND){
+		size_t size;
+		void *buffer = host_data(data, size);
+		if (buffer) memcpy(data_container, buffer, size / ((size_t)this->width * this->height) * width * height);
+		return;
+	}
+
+	switch (data)
+	{
+	case DSCore::LEFT_DISP_DATA:
+		cudaMemcpy(data_container, d_left_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToHost);
+		break;
+	case DSCore::RIGHT_DISP_DATA:
+		cudaMemcpy(data_container, d_right_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToHost);
+		break;
+	case DSCore::FINAL_DISP_DATA:
+		cudaMemcpy(data_container, d_final_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToHost);
+		break;
+	default:
+		break;
+	}
+}
+
+int DSCore::get_subpixel_bits(){
+	return subpixel_bits;
+}
+
+void DSCore::set_uniqueness_ratio(float ratio){
+	uniqueness_ratio = ratio;
+}
+
+void DSCore::set_pyramid(int factor, int radius){
+	pyramid_factor = factor >= 4 ? 4 : 2;
+	pyramid_radius = std::min(std::max(radius, 1), (HOST_DISPARITY_CHUNK - 1) / 2);
+}
+
+void DSCore::set_temporal(int radius, int change_threshold, int refresh_interval){
+	temporal_radius = std::min(std::max(radius, 1), (HOST_DISPARITY_CHUNK - 1) / 2);
+	temporal_threshold = std::max(change_threshold, 0);
+	temporal_refresh = std::max(refresh_interval, 1);
+	temporal_age = -1;
+}
+
+void DSCore::set_change_detection(int tile, int change_threshold){
+	this->change_tile = (std::max(tile, 16) + 15) / 16 * 16;
+	this->change_threshold = std::max(change_threshold, 0);
+	h_prior_left.clear();
+}
+
+void DSCore::set_adaptive_range(int margin, int refresh_interval){
+	range_margin = std::max(margin, 0);
+	range_refresh = std::max(refresh_interval, 1);
+	range_age = 0;
+	active_min = min_disparity;
+	active_disparities = disparities;
+}
+
+void DSCore::get_active_range(int &min_disparity, int &disparities){
+	min_disparity = active_min;
+	disparities = active_disparities;
+}
+
+int DSCore::get_outlier_count(){
+	return outlier_count;
+}
+
+int DSCore::get_disparity_size(){
+	return (backend == HOST_BACKEND && (options & INTEGER_DISPARITY)) ? 1 : 2;
+}
+
 void DSCore::copy_from_device_to_host(void *data_container, core_data data){
+	if (backend == HOST_BACKEND){
+		size_t size;
+		void *buffer = host_data(data, size);
+		if (buffer) memcpy(data_container, buffer, size);
+		return;
+	}
+
 	switch (data)
 	{
 	case DSCore::LEFT_DATA:
@@ -205,6 +464,11 @@ void DSCore::copy_from_device_to_host(void *data_container, core_data data){
 
 void DSCore::stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations){
 
+	if (backend == HOST_BACKEND){
+		host_stereo_match(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+		return;
+	}
+
 	//Perform census transform
 	census_transform(left_tex, d_left_census, width, height, 0);
 	census_transform(right_tex, d_right_census, width, height, 0);
@@ -249,6 +513,18 @@ void DSCore::stereo_match(int arm_length, int max_arm_length, int arm_threshold,
 
 void DSCore::stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height){
 
+	if (backend == HOST_BACKEND){
+		host_stereo_match(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+		return;
+	}
+
+	//Maps are width x height, they go to the arrays row by row for the textures to address them by the full width.
+	//Texels past them are zeroed once, from the disparity buffers before they are written
+	cudaMemset(d_left_disp, 0, this->width * this->height * sizeof(unsigned short));
+	cudaMemset(d_right_disp, 0, this->width * this->height * sizeof(unsigned short));
+	clear_array_margin(left_disp_array, d_left_disp, sizeof(unsigned short), width, height, this->width, this->height);
+	clear_array_margin(right_disp_array, d_right_disp, sizeof(unsigned short), width, height, this->width, this->height);
+
 	//Perform census transform
 	census_transform(left_tex, d_left_census, width, height, 0);
 	census_transform(right_tex, d_right_census, width, height, 0);
@@ -258,35 +534,492 @@ void DSCore::stereo_match(int arm_length, int max_arm_length, int arm_threshold,
 
 	//Match right to left
 	match(d_left, d_right, d_left_census, d_right_census, d_cost_vol_temp_a, d_cost_vol_temp_b, d_arm_vol, d_right_disp, ad_gamma, census_gamma, false, width, height, disparities, 0);
-	cudaMemcpyToArrayAsync(right_disp_array, 0, 0, d_right_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToDevice);
+	cudaMemcpy2DToArrayAsync(right_disp_array, 0, 0, d_right_disp, width * sizeof(unsigned short), width * sizeof(unsigned short), height, cudaMemcpyDeviceToDevice);
 
 	//Create left cross
 	cross_construct(left_tex, d_arm_vol, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, width, height, 0);
 
 	//Match right to left
 	match(d_left, d_right, d_left_census, d_right_census, d_cost_vol_temp_a, d_cost_vol_temp_b, d_arm_vol, d_left_disp, ad_gamma, census_gamma, true, width, height, disparities, 0);
-	cudaMemcpyToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToDevice);
+	cudaMemcpy2DToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * sizeof(unsigned short), width * sizeof(unsigned short), height, cudaMemcpyDeviceToDevice);
 
 	//Check the consistency
 	check_consistency(left_disp_tex, right_disp_tex, d_left_disp, disparity_tolerance, width, height, 0);
-	cudaMemcpyToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToDevice);
+	cudaMemcpy2DToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * sizeof(unsigned short), width * sizeof(unsigned short), height, cudaMemcpyDeviceToDevice);
 
 	//Region voting
 	for (int voting_iter = 0; voting_iter < region_voting_iterations; voting_iter++){
 		if (voting_iter % 2 == 0){
 			horizontal_voting(left_disp_tex, d_arm_vol, d_left_disp, width, height, 0);
-			cudaMemcpyToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToDevice);
+			cudaMemcpy2DToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * sizeof(unsigned short), width * sizeof(unsigned short), height, cudaMemcpyDeviceToDevice);
 			vertical_voting(left_disp_tex, d_arm_vol, d_left_disp, width, height, 0);
-			cudaMemcpyToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToDevice);
+			cudaMemcpy2DToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * sizeof(unsigned short), width * sizeof(unsigned short), height, cudaMemcpyDeviceToDevice);
 		}
 		else{
 			vertical_voting(left_disp_tex, d_arm_vol, d_left_disp, width, height, 0);
-			cudaMemcpyToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToDevice);
+			cudaMemcpy2DToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * sizeof(unsigned short), width * sizeof(unsigned short), height, cudaMemcpyDeviceToDevice);
 			horizontal_voting(left_disp_tex, d_arm_vol, d_left_disp, width, height, 0);
-			cudaMemcpyToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * height * sizeof(unsigned short), cudaMemcpyDeviceToDevice);
+			cudaMemcpy2DToArrayAsync(left_disp_array, 0, 0, d_left_disp, width * sizeof(unsigned short), width * sizeof(unsigned short), height, cudaMemcpyDeviceToDevice);
 		}
 	}
 
 	//Median Filter
 	median_filter(d_left_disp, d_final_disp, width, height);
-}
\ No newline at end of file
+}
+
+void DSCore::stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, const unsigned char *mask){
+
+	if (backend == HOST_BACKEND){
+		host_stereo_match(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, mask);
+		return;
+	}
+
+	//The device kernels run on whole frames
+	stereo_match(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations);
+}
+
+template <typename D>
+void DSCore::host_match_pair(const unsigned char *left, const unsigned char *right, const unsigned long long int *left_census, const unsigned long long int *right_census,
+	const uchar4 *left_arm_vol, const uchar4 *right_arm_vol, D *left_disp, D *right_disp, unsigned char *confidence, const host_search_window *window,
+	int max_arm_length, float ad_gamma, float census_gamma, float uniqueness_ratio, int width, int height, int min_disparity, int disparities){
+
+	bool fixed_point = (options & FIXED_POINT_COST) != 0;
+
+	if (options & STREAMING_VOLUME){
+		size_t band_size = host_streaming_volume_size(width, height, window ? window->size : disparities, max_arm_length, threads);
+
+		if (fixed_point){
+			if (h_fixed_band_vol.size() < band_size) h_fixed_band_vol.resize(band_size);
+			host_match_streaming_fixed(left, right, left_census, right_census, h_fixed_band_vol.data(), left_arm_vol, right_arm_vol, left_disp, right_disp, confidence, window, ad_gamma, census_gamma, uniqueness_ratio, max_arm_length, width, height, min_disparity, disparities, threads);
+		}
+		else{
+			if (h_band_vol.size() < band_size) h_band_vol.resize(band_size);
+			host_match_streaming(left, right, left_census, right_census, h_band_vol.data(), left_arm_vol, right_arm_vol, left_disp, right_disp, confidence, window, ad_gamma, census_gamma, uniqueness_ratio, max_arm_length, width, height, min_disparity, disparities, threads);
+		}
+		return;
+	}
+
+	//Volumes are sized at setup except for the pyramid, whose levels and windows need less
+	size_t volume_size = (size_t)width * height * host_disparity_chunk(window ? window->size : disparities);
+
+	if (fixed_point){
+		if (h_fixed_cost_vol_a.size() < volume_size) h_fixed_cost_vol_a.resize(volume_size);
+		if (right_disp && h_fixed_cost_vol_b.size() < volume_size) h_fixed_cost_vol_b.resize(volume_size);
+		host_match_fixed(left, right, left_census, right_census, h_fixed_cost_vol_a.data(), h_fixed_cost_vol_b.data(), left_arm_vol, right_arm_vol, left_disp, right_disp, confidence, window, ad_gamma, census_gamma, uniqueness_ratio, width, height, min_disparity, disparities, threads);
+	}
+	else{
+		if (h_cost_vol_temp_a.size() < volume_size) h_cost_vol_temp_a.resize(volume_size);
+		if (right_disp && h_cost_vol_temp_b.size() < volume_size) h_cost_vol_temp_b.resize(volume_size);
+		host_match(left, right, left_census, right_census, h_cost_vol_temp_a.data(), h_cost_vol_temp_b.data(), left_arm_vol, right_arm_vol, left_disp, right_disp, confidence, window, ad_gamma, census_gamma, uniqueness_ratio, width, height, min_disparity, disparities, threads);
+	}
+}
+
+host_search_window DSCore::host_pyramid_windows(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int radius, bool fill_missing, int width, int height){
+	bool pair = !(options & SINGLE_PASS);
+	int factor = pyramid_factor;
+	int coarse_width = width / factor, coarse_height = height / factor;
+	size_t coarse_size = (size_t)coarse_width * coarse_height;
+
+	//The coarse range covers the full one at 1 / factor, its arms shrink with the frame
+	int coarse_min = active_min / factor;
+	int coarse_disparities = (active_min + active_disparities + factor - 1) / factor - coarse_min;
+	int coarse_arm_length = std::max(arm_length / factor, 1), coarse_max_arm_length = std::max(max_arm_length / factor, 2);
+
+	h_coarse_left.resize(coarse_size);
+	h_coarse_right.resize(coarse_size);
+	h_coarse_left_census.resize(coarse_size);
+	h_coarse_right_census.resize(coarse_size);
+	h_coarse_arm_vol.resize(coarse_size);
+	h_coarse_left_disp.resize(coarse_size);
+	h_left_window.resize(width * height);
+	if (pair){
+		h_coarse_right_arm_vol.resize(coarse_size);
+		h_coarse_right_disp.resize(coarse_size);
+		h_right_window.resize(width * height);
+	}
+
+	host_parallel_pair(threads,
+		[&](int group_threads){
+			host_downsample(h_left.data(), h_coarse_left.data(), width, height, factor, group_threads);
+			host_census_transform(h_coarse_left.data(), h_coarse_left_census.data(), coarse_width, coarse_height, group_threads);
+			host_cross_construct(h_coarse_left.data(), h_coarse_arm_vol.data(), coarse_arm_length, coarse_max_arm_length, arm_threshold, strict_arm_threshold, coarse_width, coarse_height, group_threads);
+		},
+		[&](int group_threads){
+			host_downsample(h_right.data(), h_coarse_right.data(), width, height, factor, group_threads);
+			host_census_transform(h_coarse_right.data(), h_coarse_right_census.data(), coarse_width, coarse_height, group_threads);
+			if (pair) host_cross_construct(h_coarse_right.data(), h_coarse_right_arm_vol.data(), coarse_arm_length, coarse_max_arm_length, arm_threshold, strict_arm_threshold, coarse_width, coarse_height, group_threads);
+		});
+
+	//Raw winners of the whole coarse range, each direction centres the windows of its own reference
+	host_match_pair(h_coarse_left.data(), h_coarse_right.data(), h_coarse_left_census.data(), h_coarse_right_census.data(), h_coarse_arm_vol.data(), h_coarse_right_arm_vol.data(),
+		h_coarse_left_disp.data(), pair ? h_coarse_right_disp.data() : (unsigned short*)NULL, (unsigned char*)NULL, (const host_search_window*)NULL,
+		coarse_max_arm_length, ad_gamma, census_gamma, 1.0f, coarse_width, coarse_height, coarse_min, coarse_disparities);
+
+	int coarse_subpixel_bits = host_subpixel_bits(coarse_min, coarse_disparities);
+	host_search_windows(h_coarse_left_disp.data(), coarse_width, coarse_height, coarse_subpixel_bits, factor, radius, h_left_window.data(), fill_missing, width, height, active_min, active_disparities, threads);
+	if (pair) host_search_windows(h_coarse_right_disp.data(), coarse_width, coarse_height, coarse_subpixel_bits, factor, radius, h_right_window.data(), fill_missing, width, height, active_min, active_disparities, threads);
+
+	host_search_window window = { h_left_window.data(), pair ? h_right_window.data() : NULL, std::min(2 * radius + 1, active_disparities) };
+	return window;
+}
+
+bool DSCore::host_temporal_windows(host_search_window &window, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int width, int height){
+	bool pair = !(options & SINGLE_PASS);
+	int size = width * height;
+
+	h_left_window.resize(size);
+	if (pair) h_right_window.resize(size);
+
+	//Windows around the prior where it still holds, the rest are left at HOST_NO_WINDOW
+	int missing = host_prior_windows(h_prior_left_disp.data(), h_prior_left.data(), h_left.data(), temporal_threshold, subpixel_bits, temporal_radius,
+		h_left_window.data(), width, height, active_min, active_disparities, threads);
+	if (pair) missing += host_prior_windows(h_prior_right_disp.data(), h_prior_right.data(), h_right.data(), temporal_threshold, subpixel_bits, temporal_radius,
+		h_right_window.data(), width, height, active_min, active_disparities, threads);
+
+	//With most of the scene changed the coarse level and the windows cost more than searching the range outright
+	if (missing > (pair ? size : size / 2)) return false;
+
+	//The others search the full range at the coarse level
+	if (missing > 0) window = host_pyramid_windows(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, temporal_radius, true, width, height);
+	else{
+		host_search_window prior_window = { h_left_window.data(), pair ? h_right_window.data() : NULL, std::min(2 * temporal_radius + 1, active_disparities) };
+		window = prior_window;
+	}
+	return true;
+}
+
+void DSCore::host_adapt_range(int valid_count){
+	int end = min_disparity + disparities;
+
+	//Nothing left to go by, search everything
+	if (valid_count == 0){
+		active_min = min_disparity;
+		active_disparities = disparities;
+		return;
+	}
+
+	//Used span without the stray tails, each side within 1/1000 of the valid pixels
+	int tail = valid_count / 1000;
+	int low = min_disparity, high = end;
+	for (int count = 0; (count += h_range_histogram[low]) <= tail && low < high;) low++;
+	for (int count = 0; (count += h_range_histogram[high]) <= tail && high > low;) high--;
+
+	//Grow at once, shrink only past the margin, so a scene on the edge of the range does not toggle it each frame
+	int want_min = std::max(low - range_margin, min_disparity), want_end = std::min(high + 1 + range_margin, end);
+	int active_end = active_min + active_disparities;
+	if (want_min < active_min || want_min > active_min + range_margin) active_min = want_min;
+	if (want_end > active_end || want_end < active_end - range_margin) active_end = want_end;
+
+	//The matcher picks its fractional bits from the end of the range, it has to pick the ones of the maps
+	if (!(options & INTEGER_DISPARITY) && subpixel_bits < 8) active_end = std::max(active_end, (1 << (15 - subpixel_bits)) + 1);
+	active_min = std::min(active_min, active_end - 1);
+	active_disparities = active_end - active_min;
+}
+
+template <typename D>
+void DSCore::host_disparity_stages(std::vector<D> &left_disp, std::vector<D> &right_disp, std::vector<D> &disp_temp, std::vector<D> &final_disp, const host_search_window *window,
+	int max_arm_length, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height){
+
+	//Match both directions in one sweep over the rows, or the left one alone in a single pass
+	bool pair = !(options & SINGLE_PASS);
+	host_match_pair(h_left.data(), h_right.data(), h_left_census.data(), h_right_census.data(), h_arm_vol.data(), h_right_arm_vol.data(),
+		left_disp.data(), pair ? right_disp.data() : (D*)NULL, (options & CONFIDENCE_MAP) ? h_confidence.data() : (unsigned char*)NULL, window,
+		max_arm_length, ad_gamma, census_gamma, uniqueness_ratio, width, height, active_min, active_disparities);
+
+	if (pair){
+
+		//Check the consistency
+		host_check_consistency(left_disp.data(), right_disp.data(), disp_temp.data(), disparity_tolerance, subpixel_bits, width, height, threads);
+		left_disp.swap(disp_temp);
+	}
+
+	//Region voting over the list of remaining outliers. An iteration that resolves none leaves the map as it was, so
+	//every later one would too
+	outlier_count = host_collect_outliers(left_disp.data(), h_outliers.data(), width, height);
+
+	for (int voting_iter = 0; voting_iter < region_voting_iterations && outlier_count > 0; voting_iter++){
+		int previous_count = outlier_count;
+
+		if (voting_iter % 2 == 0){
+			host_horizontal_voting(left_disp.data(), h_arm_vol.data(), h_outliers.data(), outlier_count, width, height, threads);
+			outlier_count = host_compact_outliers(left_disp.data(), h_outliers.data(), outlier_count);
+			host_vertical_voting(left_disp.data(), h_arm_vol.data(), h_outliers.data(), outlier_count, width, height, threads);
+			outlier_count = host_compact_outliers(left_disp.data(), h_outliers.data(), outlier_count);
+		}
+		else{
+			host_vertical_voting(left_disp.data(), h_arm_vol.data(), h_outliers.data(), outlier_count, width, height, threads);
+			outlier_count = host_compact_outliers(left_disp.data(), h_outliers.data(), outlier_count);
+			host_horizontal_voting(left_disp.data(), h_arm_vol.data(), h_outliers.data(), outlier_count, width, height, threads);
+			outlier_count = host_compact_outliers(left_disp.data(), h_outliers.data(), outlier_count);
+		}
+
+		if (outlier_count == previous_count) break;
+	}
+
+	//Occlusion filling
+	if (options & HOLE_FILLING) host_fill_holes(left_disp.data(), width, height, threads);
+
+	//Median Filter
+	host_median_filter(left_disp.data(), final_disp.data(), width, height, threads);
+
+	//Range of the next frame from where this one's disparities fell
+	if (options & ADAPTIVE_RANGE){
+		h_range_histogram.resize(min_disparity + disparities + 1);
+		int valid_count = host_disparity_histogram(final_disp.data(), h_range_histogram.data(), (int)h_range_histogram.size(), subpixel_bits, width, height);
+		host_adapt_range(valid_count);
+	}
+
+	//Priors of the next frame, the right map was never checked so it stays raw
+	if (options & TEMPORAL_PRIOR){
+		h_prior_left_disp.assign(final_disp.begin(), final_disp.begin() + width * height);
+		if (pair) h_prior_right_disp.assign(right_disp.begin(), right_disp.begin() + width * height);
+	}
+}
+
+void DSCore::host_match_frame(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height){
+
+	bool color_arms = (options & COLOR_ARMS) != 0;
+	bool pair = !(options & SINGLE_PASS);
+
+	//Every refresh_interval-th frame of an adaptive range searches the whole range again
+	if (!(options & ADAPTIVE_RANGE) || ++range_age >= range_refresh){
+		active_min = min_disparity;
+		active_disparities = disparities;
+		range_age = 0;
+	}
+
+	//Census transform and cross of each image on its own half of the threads, the left cross stays in h_arm_vol for region voting
+	host_parallel_pair(threads,
+		[&](int group_threads){
+			host_census_transform(h_left.data(), h_left_census.data(), width, height, group_threads);
+			if (color_arms)
+				host_cross_construct_bgr(h_left_color.data(), h_arm_vol.data(), arm_length, max_arm_length, arm_threshold, strict_arm_threshold, width, height, group_threads);
+			else
+				host_cross_construct(h_left.data(), h_arm_vol.data(), arm_length, max_arm_length, arm_threshold, strict_arm_threshold, width, height, group_threads);
+		},
+		[&](int group_threads){
+			host_census_transform(h_right.data(), h_right_census.data(), width, height, group_threads);
+			if (!pair) return;
+			if (color_arms)
+				host_cross_construct_bgr(h_right_color.data(), h_right_arm_vol.data(), arm_length, max_arm_length, arm_threshold, strict_arm_threshold, width, height, group_threads);
+			else
+				host_cross_construct(h_right.data(), h_right_arm_vol.data(), arm_length, max_arm_length, arm_threshold, strict_arm_threshold, width, height, group_threads);
+		});
+
+	//Temporal prior: windows around the previous frame's disparities, until a refresh is due or the frame size changed
+	host_search_window window;
+	const host_search_window *search_window = NULL;
+	bool prior = (options & TEMPORAL_PRIOR) && temporal_age >= 0 && temporal_age < temporal_refresh - 1 && h_prior_left_disp.size() == (size_t)width * height;
+	if (prior && host_temporal_windows(window, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, width, height)){
+		search_window = &window;
+		temporal_age++;
+	}
+	else{
+		temporal_age = 0;
+
+		//Coarse-to-fine: full-resolution candidates around the estimate of a downsampled match
+		if (options & PYRAMID_MATCHING){
+			window = host_pyramid_windows(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, pyramid_radius, false, width, height);
+			search_window = &window;
+		}
+	}
+
+	//The rest runs on subpixel or integer maps
+	if (options & INTEGER_DISPARITY)
+		host_disparity_stages(h_left_int_disp, h_right_int_disp, h_int_disp_temp, h_final_int_disp, search_window, max_arm_length, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+	else
+		host_disparity_stages(h_left_disp, h_right_disp, h_disp_temp, h_final_disp, search_window, max_arm_length, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+
+	if (options & TEMPORAL_PRIOR){
+		h_prior_left.assign(h_left.begin(), h_left.begin() + width * height);
+		if (pair) h_prior_right.assign(h_right.begin(), h_right.begin() + width * height);
+	}
+}
+
+//Copies row_count rows of row_length elements between buffers of different row strides
+template <typename T>
+static void copy_region(const T *source, int source_stride, T *target, int target_stride, int row_count, int row_length){
+	for (int row = 0; row < row_count; row++) memcpy(target + (size_t)row * target_stride, source + (size_t)row * source_stride, row_length * sizeof(T));
+}
+
+template <typename D>
+void DSCore::host_match_regions(std::vector<D> &final_disp, std::vector<D> &kept_disp, const unsigned char *tiles, int tile, int halo_left, int halo_right, int halo_y, bool update_reference,
+	int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height){
+
+	bool color_arms = (options & COLOR_ARMS) != 0;
+	bool pair = !(options & SINGLE_PASS);
+	bool confidence = (options & CONFIDENCE_MAP) != 0;
+	int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+
+	//The full frames move aside, each region is cropped from them into the frame buffers and matched as a frame of its own
+	h_frame_left.resize(h_left.size());
+	h_frame_right.resize(h_right.size());
+	h_frame_left.swap(h_left);
+	h_frame_right.swap(h_right);
+	if (color_arms){
+		h_frame_left_color.resize(h_left_color.size());
+		h_frame_left_color.swap(h_left_color);
+		if (pair){
+			h_frame_right_color.resize(h_right_color.size());
+			h_frame_right_color.swap(h_right_color);
+		}
+	}
+
+	//Marked tile rows closer than two halos share a region
+	int gap_rows = (2 * halo_y + tile - 1) / tile;
+
+	for (int tile_row = 0; tile_row < tiles_y; tile_row++){
+		int col_begin = tiles_x, col_end = 0, row_end = tile_row;
+
+		for (int band_row = tile_row; band_row < tiles_y && band_row <= row_end + gap_rows; band_row++){
+			for (int tile_col = 0; tile_col < tiles_x; tile_col++){
+				if (!tiles[band_row * tiles_x + tile_col]) continue;
+				col_begin = std::min(col_begin, tile_col);
+				col_end = std::max(col_end, tile_col + 1);
+				row_end = band_row + 1;
+			}
+			if (col_begin == tiles_x) break;
+		}
+		if (col_begin == tiles_x) continue;
+
+		//Region to update and the crop matched for it
+		int x0 = col_begin * tile, x1 = std::min(col_end * tile, width), y0 = tile_row * tile, y1 = std::min(row_end * tile, height);
+		int crop_x0 = std::max(x0 - halo_left, 0), crop_x1 = std::min(x1 + halo_right, width), crop_y0 = std::max(y0 - halo_y, 0), crop_y1 = std::min(y1 + halo_y, height);
+		int crop_width = crop_x1 - crop_x0, crop_height = crop_y1 - crop_y0;
+
+		copy_region(h_frame_left.data() + (size_t)crop_y0 * width + crop_x0, width, h_left.data(), crop_width, crop_height, crop_width);
+		copy_region(h_frame_right.data() + (size_t)crop_y0 * width + crop_x0, width, h_right.data(), crop_width, crop_height, crop_width);
+		if (color_arms){
+			copy_region(h_frame_left_color.data() + ((size_t)crop_y0 * width + crop_x0) * 3, width * 3, h_left_color.data(), crop_width * 3, crop_height, crop_width * 3);
+			if (pair) copy_region(h_frame_right_color.data() + ((size_t)crop_y0 * width + crop_x0) * 3, width * 3, h_right_color.data(), crop_width * 3, crop_height, crop_width * 3);
+		}
+
+		host_match_frame(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, crop_width, crop_height);
+
+		//Keep the region's disparities, and make its frames the reference they were computed from
+		size_t crop_offset = (size_t)(y0 - crop_y0) * crop_width + (x0 - crop_x0), frame_offset = (size_t)y0 * width + x0;
+		copy_region(final_disp.data() + crop_offset, crop_width, kept_disp.data() + frame_offset, width, y1 - y0, x1 - x0);
+		if (confidence) copy_region(h_confidence.data() + crop_offset, crop_width, h_kept_confidence.data() + frame_offset, width, y1 - y0, x1 - x0);
+		if (update_reference){
+			copy_region(h_frame_left.data() + frame_offset, width, h_prior_left.data() + frame_offset, width, y1 - y0, x1 - x0);
+			copy_region(h_frame_right.data() + frame_offset, width, h_prior_right.data() + frame_offset, width, y1 - y0, x1 - x0);
+		}
+
+		tile_row = row_end - 1;
+	}
+
+	h_frame_left.swap(h_left);
+	h_frame_right.swap(h_right);
+	if (color_arms){
+		h_frame_left_color.swap(h_left_color);
+		if (pair) h_frame_right_color.swap(h_right_color);
+	}
+}
+
+template <typename D>
+void DSCore::host_tiled_match(std::vector<D> &final_disp, std::vector<D> &kept_disp, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold,
+	float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height){
+
+	size_t size = (size_t)width * height;
+	bool confidence = (options & CONFIDENCE_MAP) != 0;
+
+	//Without a reference of this size the whole frame is matched and kept
+	if (h_prior_left.size() != size || kept_disp.size() != size){
+		host_match_frame(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+		kept_disp.assign(final_disp.begin(), final_disp.begin() + size);
+		if (confidence) h_kept_confidence.assign(h_confidence.begin(), h_confidence.begin() + size);
+		h_prior_left.assign(h_left.begin(), h_left.begin() + size);
+		h_prior_right.assign(h_right.begin(), h_right.begin() + size);
+		return;
+	}
+
+	//Tiles that moved since their disparities were computed. A right tile also changes the left pixels up to a range
+	//to its right, which match into it
+	int tile = change_tile;
+	int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+	int range_end = min_disparity + disparities;
+	h_changed_tiles.assign(tiles_x * tiles_y, 0);
+	host_changed_tiles(h_prior_left.data(), h_left.data(), h_changed_tiles.data(), 0, tile, change_threshold, width, height, threads);
+	host_changed_tiles(h_prior_right.data(), h_right.data(), h_changed_tiles.data(), (range_end + tile - 1) / tile, tile, change_threshold, width, height, threads);
+
+	//Kept pixels up to two arms from a change aggregated or voted over it, their tiles are matched again too
+	host_dilate_tiles(h_changed_tiles.data(), (2 * max_arm_length + tile - 1) / tile, tiles_x, tiles_y);
+
+	//Support a region's pixels draw on: the range and two arms across, aggregation then region voting, two arms down.
+	//The kept neighbours were computed with the full support on both sides, so is the region
+	int halo_x = range_end + 2 * max_arm_length;
+	host_match_regions(final_disp, kept_disp, h_changed_tiles.data(), tile, halo_x, halo_x, 2 * max_arm_length, true,
+		arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+
+	std::copy(kept_disp.begin(), kept_disp.end(), final_disp.begin());
+	if (confidence) std::copy(h_kept_confidence.begin(), h_kept_confidence.end(), h_confidence.begin());
+	outlier_count = host_collect_outliers(final_disp.data(), h_outliers.data(), width, height);
+}
+
+template <typename D>
+void DSCore::host_masked_match(std::vector<D> &final_disp, std::vector<D> &kept_disp, const unsigned char *mask, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold,
+	float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height){
+
+	size_t size = (size_t)width * height;
+	bool confidence = (options & CONFIDENCE_MAP) != 0;
+
+	kept_disp.assign(size, OUTLIER);
+	if (confidence) h_kept_confidence.assign(size, 0);
+
+	int tile = change_tile;
+	int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+	h_changed_tiles.assign(tiles_x * tiles_y, 0);
+	host_mask_tiles(mask, h_changed_tiles.data(), tile, width, height, threads);
+
+	//Masked pixels match into the range to their left, and the right winners their consistency check reads search a
+	//range to their right, so the support is the range and two arms across either way, two arms down
+	//Regions are not frames of a sequence: each one searches the full range, and the temporal prior and adaptive range
+	//of the frames around this one are left as they were
+	int sequence_options = options, sequence_min = active_min, sequence_disparities = active_disparities;
+	int sequence_range_age = range_age, sequence_temporal_age = temporal_age;
+	options &= ~(TEMPORAL_PRIOR | ADAPTIVE_RANGE);
+
+	int halo_x = min_disparity + disparities + 2 * max_arm_length;
+	host_match_regions(final_disp, kept_disp, h_changed_tiles.data(), tile, halo_x, halo_x, 2 * max_arm_length, false,
+		arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+
+	options = sequence_options;
+	active_min = sequence_min;
+	active_disparities = sequence_disparities;
+	range_age = sequence_range_age;
+	temporal_age = sequence_temporal_age;
+
+	//Disparities of the masked pixels only
+	outlier_count = 0;
+	for (size_t pixel = 0; pixel < size; pixel++){
+		final_disp[pixel] = mask[pixel] ? kept_disp[pixel] : (D)OUTLIER;
+		if (confidence) h_confidence[pixel] = mask[pixel] ? h_kept_confidence[pixel] : 0;
+		if (mask[pixel] && final_disp[pixel] == OUTLIER) outlier_count++;
+	}
+
+	//The kept map now holds the mask's pixels only, a CHANGE_DETECTION frame after this one starts over
+	kept_disp.clear();
+}
+
+void DSCore::host_stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height){
+
+	if (!(options & CHANGE_DETECTION)){
+		host_match_frame(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+		return;
+	}
+
+	//Only the regions around changed tiles are matched again, on subpixel or integer maps
+	if (options & INTEGER_DISPARITY)
+		host_tiled_match(h_final_int_disp, h_kept_int_disp, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+	else
+		host_tiled_match(h_final_disp, h_kept_disp, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+}
+
+void DSCore::host_stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, const unsigned char *mask){
+
+	//Only the regions around masked tiles are matched, on subpixel or integer maps
+	if (options & INTEGER_DISPARITY)
+		host_masked_match(h_final_int_disp, h_kept_int_disp, mask, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+	else
+		host_masked_match(h_final_disp, h_kept_disp, mask, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, width, height);
+}
@@ -1,15 +1,53 @@
 #pragma once
 #include <iostream>
+#include <vector>
 
 #include "cuda_runtime.h"
 #include "device_launch_parameters.h"
 
 #include "DSKernels.cuh"
+#include "DSHostKernels.h"
 
 class DSCore{
+public:
+	//Backends available
+	enum core_backend{ CUDA_BACKEND, HOST_BACKEND };
+
+	//Host backend options, combined as bit flags
+	enum core_options{
+		DEFAULT_OPTIONS = 0,
+		STREAMING_VOLUME = 1, //Match over a sliding band of rows instead of full cost volumes
+		FIXED_POINT_COST = 2, //Integer costs: uint16 per-pixel cost, exact 32-bit aggregation in volumes the size of the float ones (see host_match_fixed)
+		HOLE_FILLING = 4, //Fill the outliers left after region voting from their row neighbours (see host_fill_holes)
+		COLOR_ARMS = 8, //Build the crosses from the BGR frames (LEFT_COLOR_DATA, RIGHT_COLOR_DATA), costs stay on gray
+		INTEGER_DISPARITY = 16, //8-bit integer disparity maps without subpixel refinement, the range is clamped to end by 256
+		SINGLE_PASS = 32, //Match the left reference only and skip the consistency check, the right cross and map are not built
+		CONFIDENCE_MAP = 64, //8-bit confidence of each left winner from the matching stage (CONFIDENCE_DATA, see host_match)
+		PYRAMID_MATCHING = 128, //Search the whole range on downsampled frames, then only a window around it at full resolution (see set_pyramid)
+		TEMPORAL_PRIOR = 256, //Video: search only a window around the previous frame's disparities where they still hold (see set_temporal)
+		ADAPTIVE_RANGE = 512, //Video: search only the part of the range the previous frame used, with a margin (see set_adaptive_range)
+		CHANGE_DETECTION = 1024 //Video: match only around the tiles that changed and keep the other disparities, replaces the two above (see set_change_detection)
+	};
+
 private:
-	//Stereo parameters
-	int width, height, disparities;
+	//Stereo parameters, candidates are [min_disparity, min_disparity + disparities)
+	int width, height, min_disparity, disparities;
+	int subpixel_bits;
+	int outlier_count;
+	float uniqueness_ratio;
+	int pyramid_factor, pyramid_radius;
+	int temporal_radius, temporal_threshold, temporal_refresh;
+	//Frames matched on the prior since the last full range one, -1 while there is no prior
+	int temporal_age;
+	//Candidates ADAPTIVE_RANGE searches in the current frame, within the configured ones
+	int active_min, active_disparities;
+	int range_margin, range_refresh, range_age;
+	int change_tile, change_threshold;
+
+	//Backend selected at setup
+	core_backend backend;
+	int threads;
+	int options;
 
 	//Device vars
 	unsigned char *d_left;
@@ -37,20 +75,159 @@ private:
 	cudaTextureObject_t right_disp_tex;
 	cudaTextureObject_t final_disp_tex;
 
+	//Host vars
+	std::vector<unsigned char> h_left;
+	std::vector<unsigned char> h_right;
+	std::vector<unsigned char> h_left_color;
+	std::vector<unsigned char> h_right_color;
+	std::vector<unsigned long long int> h_left_census;
+	std::vector<unsigned long long int> h_right_census;
+	std::vector<uchar4> h_arm_vol;
+	std::vector<uchar4> h_right_arm_vol;
+	//Horizontal aggregates of the left to right (a) and right to left (b) directions
+	std::vector<float> h_cost_vol_temp_a;
+	std::vector<float> h_cost_vol_temp_b;
+	std::vector<unsigned short> h_left_disp;
+	std::vector<unsigned short> h_right_disp;
+	std::vector<unsigned short> h_final_disp;
+	std::vector<unsigned short> h_disp_temp;
+	//Disparity maps of INTEGER_DISPARITY, in place of the four above
+	std::vector<unsigned char> h_left_int_disp;
+	std::vector<unsigned char> h_right_int_disp;
+	std::vector<unsigned char> h_final_int_disp;
+	std::vector<unsigned char> h_int_disp_temp;
+	std::vector<unsigned char> h_confidence;
+	std::vector<int> h_outliers;
+	std::vector<float> h_band_vol;
+	std::vector<unsigned int> h_fixed_cost_vol_a;
+	std::vector<unsigned int> h_fixed_cost_vol_b;
+	std::vector<unsigned int> h_fixed_band_vol;
+	//Coarse level of PYRAMID_MATCHING and the full-resolution windows it gives
+	std::vector<unsigned char> h_coarse_left;
+	std::vector<unsigned char> h_coarse_right;
+	std::vector<unsigned long long int> h_coarse_left_census;
+	std::vector<unsigned long long int> h_coarse_right_census;
+	std::vector<uchar4> h_coarse_arm_vol;
+	std::vector<uchar4> h_coarse_right_arm_vol;
+	std::vector<unsigned short> h_coarse_left_disp;
+	std::vector<unsigned short> h_coarse_right_disp;
+	std::vector<unsigned short> h_left_window;
+	std::vector<unsigned short> h_right_window;
+	//Frames and disparities TEMPORAL_PRIOR keeps from the previous stereo_match, the right map is the raw one. The frames
+	//are also the reference of CHANGE_DETECTION, as of when each tile's disparities were last computed
+	std::vector<unsigned char> h_prior_left;
+	std::vector<unsigned char> h_prior_right;
+	std::vector<unsigned short> h_prior_left_disp;
+	std::vector<unsigned short> h_prior_right_disp;
+	std::vector<int> h_range_histogram;
+	//CHANGE_DETECTION and masked matching: marked tiles, the full frames while regions are cropped from them, and the
+	//maps the regions are kept in
+	std::vector<unsigned char> h_changed_tiles;
+	std::vector<unsigned char> h_frame_left;
+	std::vector<unsigned char> h_frame_right;
+	std::vector<unsigned char> h_frame_left_color;
+	std::vector<unsigned char> h_frame_right_color;
+	std::vector<unsigned short> h_kept_disp;
+	std::vector<unsigned char> h_kept_int_disp;
+	std::vector<unsigned char> h_kept_confidence;
+
+	void host_setup();
+	template <typename D>
+	void host_match_pair(const unsigned char *left, const unsigned char *right, const unsigned long long int *left_census, const unsigned long long int *right_census,
+		const uchar4 *left_arm_vol, const uchar4 *right_arm_vol, D *left_disp, D *right_disp, unsigned char *confidence, const host_search_window *window,
+		int max_arm_length, float ad_gamma, float census_gamma, float uniqueness_ratio, int width, int height, int min_disparity, int disparities);
+	host_search_window host_pyramid_windows(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int radius, bool fill_missing, int width, int height);
+	void host_adapt_range(int valid_count);
+	bool host_temporal_windows(host_search_window &window, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int width, int height);
+	template <typename D>
+	void host_disparity_stages(std::vector<D> &left_disp, std::vector<D> &right_disp, std::vector<D> &disp_temp, std::vector<D> &final_disp, const host_search_window *window,
+		int max_arm_length, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height);
+	void host_match_frame(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height);
+	template <typename D>
+	void host_match_regions(std::vector<D> &final_disp, std::vector<D> &kept_disp, const unsigned char *tiles, int tile, int halo_left, int halo_right, int halo_y, bool update_reference,
+		int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height);
+	template <typename D>
+	void host_masked_match(std::vector<D> &final_disp, std::vector<D> &kept_disp, const unsigned char *mask, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold,
+		float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height);
+	template <typename D>
+	void host_tiled_match(std::vector<D> &final_disp, std::vector<D> &kept_disp, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold,
+		float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height);
+	void host_stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height);
+	void host_stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, const unsigned char *mask);
+
 public:
 	DSCore();
 	~DSCore();
 
-	void setup(int width, int height, int disparities);
+	//threads = 0 uses every hardware thread; only the host backend is threaded
+	void setup(int width, int height, int disparities, core_backend backend = CUDA_BACKEND, int threads = 0, int options = DEFAULT_OPTIONS);
+
+	//Exact disparity range starting at min_disparity. The host backend matches only these candidates, in chunks when the
+	//range is wider than HOST_DISPARITY_CHUNK; the device kernels need a power of two block of candidates from zero, so
+	//the CUDA backend rounds min_disparity + disparities up to at most 256 instead
+	void setup(int width, int height, int min_disparity, int disparities, core_backend backend = CUDA_BACKEND, int threads = 0, int options = DEFAULT_OPTIONS);
+
+	//Fractional bits of the disparity maps, 8 (8.8 fixed point) unless the host range ends past 256, 0 for integer maps
+	int get_subpixel_bits();
+
+	//Bytes per disparity of the maps: 1 with INTEGER_DISPARITY on the host backend, 2 otherwise
+	int get_disparity_size();
+
+	//Winners whose aggregated cost exceeds ratio times the best cost outside their neighbours become outliers, which
+	//region voting then resolves like inconsistent ones. 1 (the default) or more disables the test; host backend only
+	void set_uniqueness_ratio(float ratio);
+
+	//Downsampling factor of the PYRAMID_MATCHING coarse level (2 or 4, default 2) and the radius of the full-resolution
+	//windows around its estimate (default 4, at most 127); host backend only
+	void set_pyramid(int factor, int radius);
+
+	//TEMPORAL_PRIOR searches radius candidates either side of the previous disparity (default 3, at most 127). Pixels
+	//that were outliers or whose intensity changed by more than change_threshold (default 12) get windows from a coarse
+	//full range match instead, and a frame where over half of them do, or every refresh_interval-th frame (default 30),
+	//searches the full range everywhere. Also drops the current prior; host backend only
+	void set_temporal(int radius, int change_threshold, int refresh_interval);
+
+	//ADAPTIVE_RANGE matches each frame over the disparities the last one used, less its 0.1% tails, plus margin (default
+	//8) either side. It grows at once and shrinks only by more than margin, and every refresh_interval-th frame (default
+	//30) searches the whole range. Ranges ending past 256 keep an end past the power of two that sets their fractional
+	//bits. Also restarts from the whole range; host backend only
+	void set_adaptive_range(int margin, int refresh_interval);
+
+	//CHANGE_DETECTION splits frames into tile x tile blocks (rounded up to a multiple of 16, default 32) and treats a block
+	//as changed when its mean absolute difference in either frame exceeds change_threshold (default 4) against the frame
+	//its disparities come from. Blocks of the right frame also change the blocks a range to their right. Only regions
+	//around the changed blocks are matched again, with a halo of the range plus two arms across and two arms down, the
+	//others keep their disparities. Also drops the reference; host backend only
+	void set_change_detection(int tile, int change_threshold);
+
+	//Candidates the next host stereo_match searches, [min_disparity, min_disparity + disparities)
+	void get_active_range(int &min_disparity, int &disparities);
+
+	//Outliers left after region voting in the last stereo_match, -1 on the CUDA backend which does not count them
+	int get_outlier_count();
 
 	//Data available
-	enum core_data{ LEFT_DATA, RIGHT_DATA, LEFT_CENSUS_DATA, RIGHT_CENSUS_DATA, ARM_DATA, COSTA_DATA, COSTB_DATA, LEFT_DISP_DATA, RIGHT_DISP_DATA, FINAL_DISP_DATA};
+	enum core_data{ LEFT_DATA, RIGHT_DATA, LEFT_CENSUS_DATA, RIGHT_CENSUS_DATA, ARM_DATA, COSTA_DATA, COSTB_DATA, LEFT_DISP_DATA, RIGHT_DISP_DATA, FINAL_DISP_DATA, LEFT_COLOR_DATA, RIGHT_COLOR_DATA, CONFIDENCE_DATA};
+
+private:
+	//Host buffer and its size in bytes for a core_data slot
+	void *host_data(core_data data, size_t &size);
+
+public:
 
 	//Synchronous copy methods
 	void copy_from_device_to_host(void *data_container, core_data data);
 	void copy_from_host_to_device(void *data_container, core_data data);
 
+	//Copies a width x height block stored contiguously, the layout stereo_match works on for a smaller frame. On the
+	//CUDA backend only the frames go in and the disparity maps come out this way
+	void copy_from_device_to_host(void *data_container, core_data data, int width, int height);
+	void copy_from_host_to_device(void *data_container, core_data data, int width, int height);
+
 	//Class methods
 	void stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations);
 	void stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, int width, int height);
+	//Disparities of the pixels where the frame-sized mask is nonzero, outliers elsewhere. The host backend matches only
+	//regions around the masked tiles (set_change_detection sets the tile size), the CUDA backend the whole frame
+	void stereo_match(int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, float ad_gamma, float census_gamma, int disparity_tolerance, int region_voting_iterations, const unsigned char *mask);
 };
\ No newline at end of file
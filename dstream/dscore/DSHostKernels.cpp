@@ -0,0 +1,2041 @@
+#include "DSHostKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DS_TARGET_AVX2
+#else
+#define DS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+//AVX-512 intrinsics need VS2019 or a GCC/Clang that knows the VPOPCNTDQ extension
+#if !defined(_MSC_VER) || _MSC_VER >= 1920
+#define DS_HAVE_AVX512
+#ifdef _MSC_VER
+#define DS_TARGET_AVX512
+#else
+#define DS_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512vpopcntdq")))
+#endif
+#endif
+
+#define CENSUS_CHUNK 32
+#define CENSUS_PAD 4
+#define VOTING_TILE 64
+#define FILL_MAX_GAP 40
+
+// Exchange trick: Morgan McGuire, ShaderX 2008 (host version of the network in DSKernels.cu)
+#define s2(a,b)            { auto tmp = a; a = std::min(a,b); b = std::max(tmp,b); }
+
+/////////////////////////////////////////////////////////////////////////////Helpers/////////////////////////////////////////////////////////////////////////////
+
+int host_default_threads(){
+	int threads = (int)std::thread::hardware_concurrency();
+	return threads > 0 ? threads : 1;
+}
+
+int host_subpixel_bits(int min_disparity, int max_disparity){
+	int subpixel_bits = 8;
+	while (subpixel_bits > 0 && min_disparity + max_disparity > (1 << (16 - subpixel_bits))) subpixel_bits--;
+	return subpixel_bits;
+}
+
+int host_disparity_chunk(int max_disparity){
+	int chunks = (max_disparity + HOST_DISPARITY_CHUNK - 1) / HOST_DISPARITY_CHUNK;
+	return (max_disparity + chunks - 1) / chunks;
+}
+
+static bool cpu_has_avx2(){
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	//AVX2 also needs the OS to save the ymm registers
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false;
+	if ((_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+static bool cpu_has_avx512_vpopcntdq(){
+#ifndef DS_HAVE_AVX512
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	//The OS has to save the opmask and zmm state too
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0) return false;
+	if ((_xgetbv(0) & 0xE6) != 0xE6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 16)) != 0 && (info[2] & (1 << 14)) != 0;
+#else
+	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+}
+
+static const bool has_avx2 = cpu_has_avx2();
+static const bool has_vpopcntdq = has_avx2 && cpu_has_avx512_vpopcntdq();
+
+//Reading the right reference costs through a shear moves more data than the vector cost engines take to recompute
+//them, it only pays off over the scalar engine
+static const bool share_costs = !has_avx2;
+
+static inline int popcount64(unsigned long long int x){
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static inline int arm_step_threshold(int scan_length, int arm_length, int arm_threshold, int strict_arm_threshold){
+	return arm_length < scan_length ? strict_arm_threshold : arm_threshold;
+}
+
+//Arm scans of pixels [begin, count) one at a time, see arm_lanes_avx2
+static void arm_lanes_scalar(const unsigned char *ref, ptrdiff_t stride, const unsigned char *limit, int steps,
+	int arm_length, int arm_threshold, int strict_arm_threshold, unsigned char *arm, int begin, int count){
+
+	for (int i = begin; i < count; i++){
+		int scan_limit = limit ? std::min(steps, (int)limit[i]) : steps;
+		int scan_length = 0, diff_curr_ref = 0;
+		while (scan_length < scan_limit){
+			int threshold = arm_step_threshold(scan_length, arm_length, arm_threshold, strict_arm_threshold);
+			int diff_curr_next = abs(ref[i] - ref[i + (scan_length + 1) * stride]);
+
+			if (diff_curr_ref > threshold || diff_curr_next > threshold) break;
+
+			diff_curr_ref = diff_curr_next;
+			scan_length++;
+		}
+		arm[i] = (unsigned char)scan_length;
+	}
+}
+
+//Arm lengths of count neighbouring pixels at once, 32 per step: pixel i compares ref[i] against ref[i + k * stride]
+//for k = 1..steps, each difference serving as the next step's current one, and stops early at limit[i] when given.
+//A block is done as soon as all its arms have stopped
+DS_TARGET_AVX2
+static void arm_lanes_avx2(const unsigned char *ref, ptrdiff_t stride, const unsigned char *limit, int steps,
+	int arm_length, int arm_threshold, int strict_arm_threshold, unsigned char *arm, int count){
+
+	const __m256i zero = _mm256_setzero_si256();
+
+	int i = 0;
+	for (; i + 32 <= count; i += 32){
+		__m256i centre = _mm256_loadu_si256((const __m256i*)(ref + i));
+		__m256i lane_limit = limit ? _mm256_loadu_si256((const __m256i*)(limit + i)) : _mm256_set1_epi8((char)0xFF);
+		__m256i diff_curr_ref = zero, alive = _mm256_set1_epi8((char)0xFF), length = zero;
+
+		for (int scan_length = 0; scan_length < steps; scan_length++){
+			int threshold = arm_step_threshold(scan_length, arm_length, arm_threshold, strict_arm_threshold);
+			if (threshold < 0) break;
+
+			__m256i next = _mm256_loadu_si256((const __m256i*)(ref + i + (scan_length + 1) * stride));
+			__m256i diff_curr_next = _mm256_or_si256(_mm256_subs_epu8(centre, next), _mm256_subs_epu8(next, centre));
+
+			//max(diffs) <= threshold and scan_length < limit
+			__m256i over = _mm256_subs_epu8(_mm256_max_epu8(diff_curr_ref, diff_curr_next), _mm256_set1_epi8((char)std::min(threshold, 255)));
+			__m256i step = _mm256_set1_epi8((char)(scan_length + 1));
+			alive = _mm256_and_si256(alive, _mm256_and_si256(_mm256_cmpeq_epi8(over, zero), _mm256_cmpeq_epi8(_mm256_max_epu8(lane_limit, step), lane_limit)));
+			if (_mm256_testz_si256(alive, alive)) break;
+
+			length = _mm256_sub_epi8(length, alive);
+			diff_curr_ref = diff_curr_next;
+		}
+
+		_mm256_storeu_si256((__m256i*)(arm + i), length);
+	}
+
+	arm_lanes_scalar(ref, stride, limit, steps, arm_length, arm_threshold, strict_arm_threshold, arm, i, count);
+}
+
+static void arm_lanes_sse2(const unsigned char *ref, ptrdiff_t stride, const unsigned char *limit, int steps,
+	int arm_length, int arm_threshold, int strict_arm_threshold, unsigned char *arm, int count){
+
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16){
+		__m128i centre = _mm_loadu_si128((const __m128i*)(ref + i));
+		__m128i lane_limit = limit ? _mm_loadu_si128((const __m128i*)(limit + i)) : _mm_set1_epi8((char)0xFF);
+		__m128i diff_curr_ref = zero, alive = _mm_set1_epi8((char)0xFF), length = zero;
+
+		for (int scan_length = 0; scan_length < steps; scan_length++){
+			int threshold = arm_step_threshold(scan_length, arm_length, arm_threshold, strict_arm_threshold);
+			if (threshold < 0) break;
+
+			__m128i next = _mm_loadu_si128((const __m128i*)(ref + i + (scan_length + 1) * stride));
+			__m128i diff_curr_next = _mm_or_si128(_mm_subs_epu8(centre, next), _mm_subs_epu8(next, centre));
+
+			__m128i over = _mm_subs_epu8(_mm_max_epu8(diff_curr_ref, diff_curr_next), _mm_set1_epi8((char)std::min(threshold, 255)));
+			__m128i step = _mm_set1_epi8((char)(scan_length + 1));
+			alive = _mm_and_si128(alive, _mm_and_si128(_mm_cmpeq_epi8(over, zero), _mm_cmpeq_epi8(_mm_max_epu8(lane_limit, step), lane_limit)));
+			if (_mm_movemask_epi8(alive) == 0) break;
+
+			length = _mm_sub_epi8(length, alive);
+			diff_curr_ref = diff_curr_next;
+		}
+
+		_mm_storeu_si128((__m128i*)(arm + i), length);
+	}
+
+	arm_lanes_scalar(ref, stride, limit, steps, arm_length, arm_threshold, strict_arm_threshold, arm, i, count);
+}
+
+//Colour arm scans of pixels [begin, count) one at a time, see arm_lanes_bgr_avx2
+static void arm_lanes_bgr_scalar(const unsigned char *const *ref, ptrdiff_t stride, const unsigned char *limit, int steps,
+	int arm_length, int arm_threshold, int strict_arm_threshold, unsigned char *arm, int begin, int count){
+
+	for (int i = begin; i < count; i++){
+		int scan_limit = limit ? std::min(steps, (int)limit[i]) : steps;
+		int scan_length = 0;
+		while (scan_length < scan_limit){
+			int threshold = arm_step_threshold(scan_length, arm_length, arm_threshold, strict_arm_threshold);
+
+			int diff_curr_ref = 0, diff_curr_next = 0;
+			for (int channel = 0; channel < 3; channel++){
+				int curr = ref[channel][i + scan_length * stride];
+				diff_curr_ref = std::max(diff_curr_ref, abs(curr - ref[channel][i]));
+				diff_curr_next = std::max(diff_curr_next, abs(curr - ref[channel][i + (scan_length + 1) * stride]));
+			}
+
+			if (diff_curr_ref > threshold || diff_curr_next > threshold) break;
+
+			scan_length++;
+		}
+		arm[i] = (unsigned char)scan_length;
+	}
+}
+
+//Colour arms with the rule of cross_construct_kernel_bgr over B, G and R planes: the largest channel difference of the
+//current pixel to the anchor and to the next pixel along the arm must both stay within the threshold. Each step's next
+//pixel is the following step's current one
+DS_TARGET_AVX2
+static void arm_lanes_bgr_avx2(const unsigned char *const *ref, ptrdiff_t stride, const unsigned char *limit, int steps,
+	int arm_length, int arm_threshold, int strict_arm_threshold, unsigned char *arm, int count){
+
+	const __m256i zero = _mm256_setzero_si256();
+
+	int i = 0;
+	for (; i + 32 <= count; i += 32){
+		__m256i centre[3], curr[3];
+		for (int channel = 0; channel < 3; channel++) centre[channel] = curr[channel] = _mm256_loadu_si256((const __m256i*)(ref[channel] + i));
+
+		__m256i lane_limit = limit ? _mm256_loadu_si256((const __m256i*)(limit + i)) : _mm256_set1_epi8((char)0xFF);
+		__m256i alive = _mm256_set1_epi8((char)0xFF), length = zero;
+
+		for (int scan_length = 0; scan_length < steps; scan_length++){
+			int threshold = arm_step_threshold(scan_length, arm_length, arm_threshold, strict_arm_threshold);
+			if (threshold < 0) break;
+
+			__m256i diff = zero;
+			for (int channel = 0; channel < 3; channel++){
+				__m256i next = _mm256_loadu_si256((const __m256i*)(ref[channel] + i + (scan_length + 1) * stride));
+				__m256i diff_curr_ref = _mm256_or_si256(_mm256_subs_epu8(curr[channel], centre[channel]), _mm256_subs_epu8(centre[channel], curr[channel]));
+				__m256i diff_curr_next = _mm256_or_si256(_mm256_subs_epu8(curr[channel], next), _mm256_subs_epu8(next, curr[channel]));
+				diff = _mm256_max_epu8(diff, _mm256_max_epu8(diff_curr_ref, diff_curr_next));
+				curr[channel] = next;
+			}
+
+			__m256i over = _mm256_subs_epu8(diff, _mm256_set1_epi8((char)std::min(threshold, 255)));
+			__m256i step = _mm256_set1_epi8((char)(scan_length + 1));
+			alive = _mm256_and_si256(alive, _mm256_and_si256(_mm256_cmpeq_epi8(over, zero), _mm256_cmpeq_epi8(_mm256_max_epu8(lane_limit, step), lane_limit)));
+			if (_mm256_testz_si256(alive, alive)) break;
+
+			length = _mm256_sub_epi8(length, alive);
+		}
+
+		_mm256_storeu_si256((__m256i*)(arm + i), length);
+	}
+
+	arm_lanes_bgr_scalar(ref, stride, limit, steps, arm_length, arm_threshold, strict_arm_threshold, arm, i, count);
+}
+
+static void arm_lanes_bgr_sse2(const unsigned char *const *ref, ptrdiff_t stride, const unsigned char *limit, int steps,
+	int arm_length, int arm_threshold, int strict_arm_threshold, unsigned char *arm, int count){
+
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16){
+		__m128i centre[3], curr[3];
+		for (int channel = 0; channel < 3; channel++) centre[channel] = curr[channel] = _mm_loadu_si128((const __m128i*)(ref[channel] + i));
+
+		__m128i lane_limit = limit ? _mm_loadu_si128((const __m128i*)(limit + i)) : _mm_set1_epi8((char)0xFF);
+		__m128i alive = _mm_set1_epi8((char)0xFF), length = zero;
+
+		for (int scan_length = 0; scan_length < steps; scan_length++){
+			int threshold = arm_step_threshold(scan_length, arm_length, arm_threshold, strict_arm_threshold);
+			if (threshold < 0) break;
+
+			__m128i diff = zero;
+			for (int channel = 0; channel < 3; channel++){
+				__m128i next = _mm_loadu_si128((const __m128i*)(ref[channel] + i + (scan_length + 1) * stride));
+				__m128i diff_curr_ref = _mm_or_si128(_mm_subs_epu8(curr[channel], centre[channel]), _mm_subs_epu8(centre[channel], curr[channel]));
+				__m128i diff_curr_next = _mm_or_si128(_mm_subs_epu8(curr[channel], next), _mm_subs_epu8(next, curr[channel]));
+				diff = _mm_max_epu8(diff, _mm_max_epu8(diff_curr_ref, diff_curr_next));
+				curr[channel] = next;
+			}
+
+			__m128i over = _mm_subs_epu8(diff, _mm_set1_epi8((char)std::min(threshold, 255)));
+			__m128i step = _mm_set1_epi8((char)(scan_length + 1));
+			alive = _mm_and_si128(alive, _mm_and_si128(_mm_cmpeq_epi8(over, zero), _mm_cmpeq_epi8(_mm_max_epu8(lane_limit, step), lane_limit)));
+			if (_mm_movemask_epi8(alive) == 0) break;
+
+			length = _mm_sub_epi8(length, alive);
+		}
+
+		_mm_storeu_si128((__m128i*)(arm + i), length);
+	}
+
+	arm_lanes_bgr_scalar(ref, stride, limit, steps, arm_length, arm_threshold, strict_arm_threshold, arm, i, count);
+}
+
+//Gray arms from one plane, colour arms from three
+static inline void arm_lanes(const unsigned char *const *ref, int channels, ptrdiff_t stride, const unsigned char *limit, int steps,
+	int arm_length, int arm_threshold, int strict_arm_threshold, unsigned char *arm, int count){
+
+	if (channels == 3){
+		if (has_avx2)
+			arm_lanes_bgr_avx2(ref, stride, limit, steps, arm_length, arm_threshold, strict_arm_threshold, arm, count);
+		else
+			arm_lanes_bgr_sse2(ref, stride, limit, steps, arm_length, arm_threshold, strict_arm_threshold, arm, count);
+	}
+	else if (has_avx2)
+		arm_lanes_avx2(ref[0], stride, limit, steps, arm_length, arm_threshold, strict_arm_threshold, arm, count);
+	else
+		arm_lanes_sse2(ref[0], stride, limit, steps, arm_length, arm_threshold, strict_arm_threshold, arm, count);
+}
+
+//dst[0..n) = a[0..n) - b[0..n), or a copy of a when b is NULL
+static inline void sub_costs(float *dst, const float *a, const float *b, int n){
+	if (!b){
+		memcpy(dst, a, n * sizeof(float));
+		return;
+	}
+
+	int d = 0;
+	for (; d + 4 <= n; d += 4) _mm_storeu_ps(dst + d, _mm_sub_ps(_mm_loadu_ps(a + d), _mm_loadu_ps(b + d)));
+	for (; d < n; d++) dst[d] = a[d] - b[d];
+}
+
+//Fixed-point sums may wrap around, the difference of two wrapped sums is still exact
+static inline void sub_costs(unsigned int *dst, const unsigned int *a, const unsigned int *b, int n){
+	if (!b){
+		memcpy(dst, a, n * sizeof(unsigned int));
+		return;
+	}
+
+	int d = 0;
+	for (; d + 4 <= n; d += 4) _mm_storeu_si128((__m128i*)(dst + d), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(a + d)), _mm_loadu_si128((const __m128i*)(b + d))));
+	for (; d < n; d++) dst[d] = a[d] - b[d];
+}
+
+//dst[0..n) = a[0..n) + dst[0..n)
+static inline void add_costs(float *dst, const float *a, int n){
+	int d = 0;
+	for (; d + 4 <= n; d += 4) _mm_storeu_ps(dst + d, _mm_add_ps(_mm_loadu_ps(a + d), _mm_loadu_ps(dst + d)));
+	for (; d < n; d++) dst[d] = a[d] + dst[d];
+}
+
+static inline void add_costs(unsigned int *dst, const unsigned int *a, int n){
+	int d = 0;
+	for (; d + 4 <= n; d += 4) _mm_storeu_si128((__m128i*)(dst + d), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(a + d)), _mm_loadu_si128((const __m128i*)(dst + d))));
+	for (; d < n; d++) dst[d] = a[d] + dst[d];
+}
+
+//Candidate disp of [0, max_disparity) refined on its parabola and offset to the absolute disparity min_disparity + disp,
+//with subpixel_bits fractional bits
+static inline unsigned short subpixel_disparity(float prev, float curr, float next, int disp, int min_disparity, int max_disparity, int subpixel_bits){
+	if (disp >= 1 && disp < max_disparity - 1){
+		float denominator = 2 * (-next - prev + 2 * curr);
+		if (denominator != 0.0f)
+			return (unsigned short)((min_disparity + disp + ((next - prev) / denominator)) * (float)(1 << subpixel_bits));
+	}
+	return (unsigned short)((min_disparity + disp) << subpixel_bits);
+}
+
+//Same parabola on exact integer costs, only the final division is rounded
+static inline unsigned short subpixel_disparity(unsigned int prev, unsigned int curr, unsigned int next, int disp, int min_disparity, int max_disparity, int subpixel_bits){
+	if (disp >= 1 && disp < max_disparity - 1){
+		long long denominator = 2 * (2 * (long long)curr - next - prev);
+		if (denominator != 0)
+			return (unsigned short)((min_disparity + disp + (float)((long long)next - prev) / (float)denominator) * (float)(1 << subpixel_bits));
+	}
+	return (unsigned short)((min_disparity + disp) << subpixel_bits);
+}
+
+//Bitwise majority over the bits of a disparity, 16 for subpixel maps and 8 for integer ones
+template <int bits>
+static inline unsigned short majority_vote(const int *sums, int eligible_votes, int no_of_votes){
+	int majority = (int)(eligible_votes * 0.5);
+
+	int disp_value = 0;
+	for (int bit = 0; bit < bits; bit++) disp_value |= (sums[bit] > majority) << bit;
+
+	return (eligible_votes > no_of_votes * 0.35f) ? (unsigned short)disp_value : OUTLIER;
+}
+
+//Running vote counts along a line of disparities: counts of valid disparities and of each set bit up to a position.
+//They wrap around in 16 bits, which keeps every difference over a window shorter than 65536 exact
+template <int bits>
+static inline void count_votes(const unsigned short *prev_bits, unsigned short prev_valid, int disp_val, unsigned short *bit_counts, unsigned short *valid){
+	const __m128i low_bits = _mm_setr_epi16(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7);
+	const __m128i high_bits = _mm_setr_epi16(1 << 8, 1 << 9, 1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14, (short)(1 << 15));
+
+	//Set bits compare to all ones, subtracting them counts one
+	__m128i value = _mm_set1_epi16((short)disp_val);
+	__m128i low = _mm_cmpeq_epi16(_mm_and_si128(value, low_bits), low_bits);
+	__m128i high = _mm_cmpeq_epi16(_mm_and_si128(value, high_bits), high_bits);
+
+	//Entries of integer maps hold only the 8 low bit counts
+	_mm_storeu_si128((__m128i*)bit_counts, _mm_sub_epi16(_mm_loadu_si128((const __m128i*)prev_bits), low));
+	if (bits > 8) _mm_storeu_si128((__m128i*)(bit_counts + 8), _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(prev_bits + 8)), high));
+	*valid = (unsigned short)(prev_valid + (disp_val != OUTLIER));
+}
+
+//Majority vote over the window between two running count entries
+template <int bits>
+static inline unsigned short window_vote(const unsigned short *end_bits, const unsigned short *begin_bits, unsigned short end_valid, unsigned short begin_valid, int no_of_votes){
+	int sums[bits];
+	for (int bit = 0; bit < bits; bit++) sums[bit] = (unsigned short)(end_bits[bit] - begin_bits[bit]);
+
+	return majority_vote<bits>(sums, (unsigned short)(end_valid - begin_valid), no_of_votes);
+}
+
+//In-place transpose of a 32x32 bit matrix, afterwards bit j of a[i] is what bit i of a[j] was
+static inline void transpose32(unsigned int *a){
+	unsigned int mask = 0x0000FFFF;
+	for (int j = 16; j != 0; j >>= 1, mask ^= (mask << j)){
+		for (int k = 0; k < 32; k = ((k | j) + 1) & ~j){
+			unsigned int t = ((a[k] >> j) ^ a[k | j]) & mask;
+			a[k] ^= t << j;
+			a[k | j] ^= t;
+		}
+	}
+}
+
+//Bit-sliced census of up to 32 pixels: one compare + movemask per window position gives that bit for every pixel,
+//the two 32x32 transposes then turn the position-major masks into per-pixel words
+static inline void census_chunk_finish(unsigned int *lo, unsigned int *hi, unsigned long long int *output_census, int count){
+	transpose32(lo);
+	transpose32(hi);
+	for (int i = 0; i < count; i++) output_census[i] = ((unsigned long long int)hi[i] << 32) | lo[i];
+}
+
+DS_TARGET_AVX2
+static void census_chunk_avx2(const unsigned char *centre, const int *offsets, unsigned long long int *output_census, int count){
+	unsigned int lo[32], hi[32];
+
+	//Unsigned compare through the signed one by flipping the sign bits
+	const __m256i bias = _mm256_set1_epi8((char)0x80);
+	__m256i ref = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)centre), bias);
+
+	for (int position = 0; position < 64; position++){
+		unsigned int bits = 0;
+		if (position != 31 && position != 32){
+			__m256i pix = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(centre + offsets[position])), bias);
+			bits = (unsigned int)_mm256_movemask_epi8(_mm256_cmpgt_epi8(pix, ref));
+		}
+
+		if (position < 32) lo[31 - position] = bits;
+		else hi[63 - position] = bits;
+	}
+
+	census_chunk_finish(lo, hi, output_census, count);
+}
+
+static void census_chunk_sse2(const unsigned char *centre, const int *offsets, unsigned long long int *output_census, int count){
+	unsigned int lo[32], hi[32];
+
+	const __m128i bias = _mm_set1_epi8((char)0x80);
+	__m128i ref_a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)centre), bias);
+	__m128i ref_b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(centre + 16)), bias);
+
+	for (int position = 0; position < 64; position++){
+		unsigned int bits = 0;
+		if (position != 31 && position != 32){
+			__m128i pix_a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(centre + offsets[position])), bias);
+			__m128i pix_b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(centre + offsets[position] + 16)), bias);
+			bits = (unsigned int)_mm_movemask_epi8(_mm_cmpgt_epi8(pix_a, ref_a)) | ((unsigned int)_mm_movemask_epi8(_mm_cmpgt_epi8(pix_b, ref_b)) << 16);
+		}
+
+		if (position < 32) lo[31 - position] = bits;
+		else hi[63 - position] = bits;
+	}
+
+	census_chunk_finish(lo, hi, output_census, count);
+}
+
+//3x3 median from sorted columns: every column of the window is sorted once into lo <= mid <= hi and shared by the
+//three pixels it belongs to, the median is then med3(max(lo), med3(mid), min(hi)) over three neighbouring columns.
+//Column arrays are indexed by column + 1 with zero columns at 0 and width + 1, the zero padding of median_filter_kernel.
+//The 16-bit SSE2 path keeps them biased by 0x8000 so signed 16-bit min/max order them as unsigned
+template <typename D>
+static inline void sort_column(D a, D b, D c, D *lo, D *mid, D *hi, D bias){
+	s2(a, b); s2(b, c); s2(a, b);
+	*lo = a ^ bias;
+	*mid = b ^ bias;
+	*hi = c ^ bias;
+}
+
+template <typename D>
+static inline D med3(D a, D b, D c){
+	return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+template <typename D>
+static inline D median_of_columns(const D *lo, const D *mid, const D *hi, D bias){
+	D low = (D)std::max(std::max(lo[0] ^ bias, lo[1] ^ bias), lo[2] ^ bias);
+	D high = (D)std::min(std::min(hi[0] ^ bias, hi[1] ^ bias), hi[2] ^ bias);
+	return med3<D>(low, med3<D>(mid[0] ^ bias, mid[1] ^ bias, mid[2] ^ bias), high);
+}
+
+DS_TARGET_AVX2
+static inline __m256i med3_epu16_avx2(__m256i a, __m256i b, __m256i c){
+	return _mm256_max_epu16(_mm256_min_epu16(a, b), _mm256_min_epu16(_mm256_max_epu16(a, b), c));
+}
+
+//Median of one row, 16 pixels per step
+DS_TARGET_AVX2
+static void median_row_avx2(const unsigned short *above, const unsigned short *row, const unsigned short *below,
+	unsigned short *lo, unsigned short *mid, unsigned short *hi, unsigned short *out, int width){
+
+	int x = 0;
+	for (; x + 16 <= width; x += 16){
+		__m256i a = _mm256_loadu_si256((const __m256i*)(above + x));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(row + x));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(below + x));
+
+		__m256i t = _mm256_min_epu16(a, b); b = _mm256_max_epu16(a, b); a = t;
+		t = _mm256_min_epu16(b, c); c = _mm256_max_epu16(b, c); b = t;
+		t = _mm256_min_epu16(a, b); b = _mm256_max_epu16(a, b); a = t;
+
+		_mm256_storeu_si256((__m256i*)(lo + x + 1), a);
+		_mm256_storeu_si256((__m256i*)(mid + x + 1), b);
+		_mm256_storeu_si256((__m256i*)(hi + x + 1), c);
+	}
+	for (; x < width; x++) sort_column<unsigned short>(above[x], row[x], below[x], lo + x + 1, mid + x + 1, hi + x + 1, 0);
+
+	x = 0;
+	for (; x + 16 <= width; x += 16){
+		__m256i low = _mm256_max_epu16(_mm256_max_epu16(_mm256_loadu_si256((const __m256i*)(lo + x)), _mm256_loadu_si256((const __m256i*)(lo + x + 1))),
+			_mm256_loadu_si256((const __m256i*)(lo + x + 2)));
+		__m256i high = _mm256_min_epu16(_mm256_min_epu16(_mm256_loadu_si256((const __m256i*)(hi + x)), _mm256_loadu_si256((const __m256i*)(hi + x + 1))),
+			_mm256_loadu_si256((const __m256i*)(hi + x + 2)));
+		__m256i middle = med3_epu16_avx2(_mm256_loadu_si256((const __m256i*)(mid + x)), _mm256_loadu_si256((const __m256i*)(mid + x + 1)),
+			_mm256_loadu_si256((const __m256i*)(mid + x + 2)));
+
+		_mm256_storeu_si256((__m256i*)(out + x), med3_epu16_avx2(low, middle, high));
+	}
+	for (; x < width; x++) out[x] = median_of_columns<unsigned short>(lo + x, mid + x, hi + x, 0);
+}
+
+static inline __m128i med3_epi16_sse2(__m128i a, __m128i b, __m128i c){
+	return _mm_max_epi16(_mm_min_epi16(a, b), _mm_min_epi16(_mm_max_epi16(a, b), c));
+}
+
+//Median of one row, 8 pixels per step on biased values
+static void median_row_sse2(const unsigned short *above, const unsigned short *row, const unsigned short *below,
+	unsigned short *lo, unsigned short *mid, unsigned short *hi, unsigned short *out, int width){
+
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+
+	int x = 0;
+	for (; x + 8 <= width; x += 8){
+		__m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(above + x)), bias);
+		__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(row + x)), bias);
+		__m128i c = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(below + x)), bias);
+
+		__m128i t = _mm_min_epi16(a, b); b = _mm_max_epi16(a, b); a = t;
+		t = _mm_min_epi16(b, c); c = _mm_max_epi16(b, c); b = t;
+		t = _mm_min_epi16(a, b); b = _mm_max_epi16(a, b); a = t;
+
+		_mm_storeu_si128((__m128i*)(lo + x + 1), a);
+		_mm_storeu_si128((__m128i*)(mid + x + 1), b);
+		_mm_storeu_si128((__m128i*)(hi + x + 1), c);
+	}
+	for (; x < width; x++) sort_column<unsigned short>(above[x], row[x], below[x], lo + x + 1, mid + x + 1, hi + x + 1, 0x8000);
+
+	x = 0;
+	for (; x + 8 <= width; x += 8){
+		__m128i low = _mm_max_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i*)(lo + x)), _mm_loadu_si128((const __m128i*)(lo + x + 1))),
+			_mm_loadu_si128((const __m128i*)(lo + x + 2)));
+		__m128i high = _mm_min_epi16(_mm_min_epi16(_mm_loadu_si128((const __m128i*)(hi + x)), _mm_loadu_si128((const __m128i*)(hi + x + 1))),
+			_mm_loadu_si128((const __m128i*)(hi + x + 2)));
+		__m128i middle = med3_epi16_sse2(_mm_loadu_si128((const __m128i*)(mid + x)), _mm_loadu_si128((const __m128i*)(mid + x + 1)),
+			_mm_loadu_si128((const __m128i*)(mid + x + 2)));
+
+		_mm_storeu_si128((__m128i*)(out + x), _mm_xor_si128(med3_epi16_sse2(low, middle, high), bias));
+	}
+	for (; x < width; x++) out[x] = median_of_columns<unsigned short>(lo + x, mid + x, hi + x, 0x8000);
+}
+
+DS_TARGET_AVX2
+static inline __m256i med3_epu8_avx2(__m256i a, __m256i b, __m256i c){
+	return _mm256_max_epu8(_mm256_min_epu8(a, b), _mm256_min_epu8(_mm256_max_epu8(a, b), c));
+}
+
+//Median of one row of an integer map, 32 pixels per step
+DS_TARGET_AVX2
+static void median_row_avx2(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+	unsigned char *lo, unsigned char *mid, unsigned char *hi, unsigned char *out, int width){
+
+	int x = 0;
+	for (; x + 32 <= width; x += 32){
+		__m256i a = _mm256_loadu_si256((const __m256i*)(above + x));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(row + x));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(below + x));
+
+		__m256i t = _mm256_min_epu8(a, b); b = _mm256_max_epu8(a, b); a = t;
+		t = _mm256_min_epu8(b, c); c = _mm256_max_epu8(b, c); b = t;
+		t = _mm256_min_epu8(a, b); b = _mm256_max_epu8(a, b); a = t;
+
+		_mm256_storeu_si256((__m256i*)(lo + x + 1), a);
+		_mm256_storeu_si256((__m256i*)(mid + x + 1), b);
+		_mm256_storeu_si256((__m256i*)(hi + x + 1), c);
+	}
+	for (; x < width; x++) sort_column<unsigned char>(above[x], row[x], below[x], lo + x + 1, mid + x + 1, hi + x + 1, 0);
+
+	x = 0;
+	for (; x + 32 <= width; x += 32){
+		__m256i low = _mm256_max_epu8(_mm256_max_epu8(_mm256_loadu_si256((const __m256i*)(lo + x)), _mm256_loadu_si256((const __m256i*)(lo + x + 1))),
+			_mm256_loadu_si256((const __m256i*)(lo + x + 2)));
+		__m256i high = _mm256_min_epu8(_mm256_min_epu8(_mm256_loadu_si256((const __m256i*)(hi + x)), _mm256_loadu_si256((const __m256i*)(hi + x + 1))),
+			_mm256_loadu_si256((const __m256i*)(hi + x + 2)));
+		__m256i middle = med3_epu8_avx2(_mm256_loadu_si256((const __m256i*)(mid + x)), _mm256_loadu_si256((const __m256i*)(mid + x + 1)),
+			_mm256_loadu_si256((const __m256i*)(mid + x + 2)));
+
+		_mm256_storeu_si256((__m256i*)(out + x), med3_epu8_avx2(low, middle, high));
+	}
+	for (; x < width; x++) out[x] = median_of_columns<unsigned char>(lo + x, mid + x, hi + x, 0);
+}
+
+static inline __m128i med3_epu8_sse2(__m128i a, __m128i b, __m128i c){
+	return _mm_max_epu8(_mm_min_epu8(a, b), _mm_min_epu8(_mm_max_epu8(a, b), c));
+}
+
+//Median of one row of an integer map, 16 pixels per step. Unsigned 8-bit min/max need no bias
+static void median_row_sse2(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+	unsigned char *lo, unsigned char *mid, unsigned char *hi, unsigned char *out, int width){
+
+	int x = 0;
+	for (; x + 16 <= width; x += 16){
+		__m128i a = _mm_loadu_si128((const __m128i*)(above + x));
+		__m128i b = _mm_loadu_si128((const __m128i*)(row + x));
+		__m128i c = _mm_loadu_si128((const __m128i*)(below + x));
+
+		__m128i t = _mm_min_epu8(a, b); b = _mm_max_epu8(a, b); a = t;
+		t = _mm_min_epu8(b, c); c = _mm_max_epu8(b, c); b = t;
+		t = _mm_min_epu8(a, b); b = _mm_max_epu8(a, b); a = t;
+
+		_mm_storeu_si128((__m128i*)(lo + x + 1), a);
+		_mm_storeu_si128((__m128i*)(mid + x + 1), b);
+		_mm_storeu_si128((__m128i*)(hi + x + 1), c);
+	}
+	for (; x < width; x++) sort_column<unsigned char>(above[x], row[x], below[x], lo + x + 1, mid + x + 1, hi + x + 1, 0);
+
+	x = 0;
+	for (; x + 16 <= width; x += 16){
+		__m128i low = _mm_max_epu8(_mm_max_epu8(_mm_loadu_si128((const __m128i*)(lo + x)), _mm_loadu_si128((const __m128i*)(lo + x + 1))),
+			_mm_loadu_si128((const __m128i*)(lo + x + 2)));
+		__m128i high = _mm_min_epu8(_mm_min_epu8(_mm_loadu_si128((const __m128i*)(hi + x)), _mm_loadu_si128((const __m128i*)(hi + x + 1))),
+			_mm_loadu_si128((const __m128i*)(hi + x + 2)));
+		__m128i middle = med3_epu8_sse2(_mm_loadu_si128((const __m128i*)(mid + x)), _mm_loadu_si128((const __m128i*)(mid + x + 1)),
+			_mm_loadu_si128((const __m128i*)(mid + x + 2)));
+
+		_mm_storeu_si128((__m128i*)(out + x), med3_epu8_sse2(low, middle, high));
+	}
+	for (; x < width; x++) out[x] = median_of_columns<unsigned char>(lo + x, mid + x, hi + x, 0);
+}
+
+//Lays out one target row so the candidates of every reference pixel are contiguous and ascending in disparity:
+//pixel col reads targ_line[base + disparity] with base = col (right to left) or width - 1 - col (left to right),
+//shifted by min_disparity for ranges that do not start at zero.
+//The tail past width is zero, like the texture border on the device
+static void orient_target_row(const unsigned char *targ_row, const unsigned long long int *targ_cen_row, unsigned char *targ_line, unsigned long long int *targ_cen_line,
+	bool left_to_right, int width, int line_length){
+
+	for (int i = 0; i < width; i++){
+		int col = left_to_right ? width - 1 - i : i;
+		targ_line[i] = targ_row[col];
+		targ_cen_line[i] = targ_cen_row[col];
+	}
+
+	memset(targ_line + width, 0, (line_length - width) * sizeof(unsigned char));
+	memset(targ_cen_line + width, 0, (line_length - width) * sizeof(unsigned long long int));
+}
+
+//Scalar cost of disparities [first, max_disparity) for one pixel. AD is normalised before it is weighted, in the order
+//of cost_initialization_kernel, so the float costs round like the device's; the census scale is a power of two
+static inline void cost_pixel_scalar(int ref, unsigned long long int ref_cen, const unsigned char *targ, const unsigned long long int *targ_cen,
+	float *out, int first, int max_disparity, float ad_gamma, float census_scale){
+
+	for (int disp = first; disp < max_disparity; disp++){
+		float ad_cost = (abs(ref - targ[disp]) / 255.0f) * ad_gamma;
+		float census_cost = popcount64(ref_cen ^ targ_cen[disp]) * census_scale;
+		out[disp] = ad_cost + census_cost;
+	}
+}
+
+static void cost_row_scalar(const unsigned char *ref_row, const unsigned long long int *ref_cen_row, const unsigned char *targ_line, const unsigned long long int *targ_cen_line,
+	int base, int base_step, const unsigned short *first_row, float *out, int width, int max_disparity, float ad_gamma, float census_scale){
+
+	for (int image_col = 0; image_col < width; image_col++, base += base_step, out += max_disparity){
+		int pix_base = base + (first_row ? first_row[image_col] : 0);
+		cost_pixel_scalar(ref_row[image_col], ref_cen_row[image_col], targ_line + pix_base, targ_cen_line + pix_base, out, 0, max_disparity, ad_gamma, census_scale);
+	}
+}
+
+//Nibble-LUT popcount of four 64-bit lanes, counts land in the low dword of each lane
+DS_TARGET_AVX2
+static inline __m256i popcount_epi64_avx2(__m256i x){
+	const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_mask = _mm256_set1_epi8(0x0F);
+
+	__m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, low_mask));
+	__m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask));
+	return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+//Stores the blended cost of 8 disparities, census distances as 8 dwords
+DS_TARGET_AVX2
+static inline void cost_step_avx2(__m256i census_counts, __m128i ref_pix, const unsigned char *targ, float *out, __m256 ad_gamma, __m256 census_scale){
+	__m128i targ_pix = _mm_loadl_epi64((const __m128i*)targ);
+	__m128i ad = _mm_or_si128(_mm_subs_epu8(ref_pix, targ_pix), _mm_subs_epu8(targ_pix, ref_pix));
+
+	__m256 ad_norm = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(ad)), _mm256_set1_ps(255.0f));
+	__m256 cost = _mm256_add_ps(_mm256_mul_ps(ad_norm, ad_gamma),
+		_mm256_mul_ps(_mm256_cvtepi32_ps(census_counts), census_scale));
+
+	_mm256_storeu_ps(out, cost);
+}
+
+DS_TARGET_AVX2
+static void cost_row_avx2(const unsigned char *ref_row, const unsigned long long int *ref_cen_row, const unsigned char *targ_line, const unsigned long long int *targ_cen_line,
+	int base, int base_step, const unsigned short *first_row, float *out, int width, int max_disparity, float ad_gamma, float census_scale){
+
+	const __m256i interleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	__m256 ad_gamma_v = _mm256_set1_ps(ad_gamma), census_scale_v = _mm256_set1_ps(census_scale);
+	int vector_end = max_disparity & ~7;
+
+	for (int image_col = 0; image_col < width; image_col++, base += base_step, out += max_disparity){
+		__m128i ref_pix = _mm_set1_epi8((char)ref_row[image_col]);
+		__m256i ref_cen = _mm256_set1_epi64x((long long)ref_cen_row[image_col]);
+
+		int pix_base = base + (first_row ? first_row[image_col] : 0);
+		const unsigned char *targ = targ_line + pix_base;
+		const unsigned long long int *targ_cen = targ_cen_line + pix_base;
+
+		for (int disp = 0; disp < vector_end; disp += 8){
+			__m256i count_a = popcount_epi64_avx2(_mm256_xor_si256(ref_cen, _mm256_loadu_si256((const __m256i*)(targ_cen + disp))));
+			__m256i count_b = popcount_epi64_avx2(_mm256_xor_si256(ref_cen, _mm256_loadu_si256((const __m256i*)(targ_cen + disp + 4))));
+			__m256i counts = _mm256_permutevar8x32_epi32(_mm256_or_si256(count_a, _mm256_slli_epi64(count_b, 32)), interleave);
+
+			cost_step_avx2(counts, ref_pix, targ + disp, out + disp, ad_gamma_v, census_scale_v);
+		}
+
+		cost_pixel_scalar(ref_row[image_col], ref_cen_row[image_col], targ, targ_cen, out, vector_end, max_disparity, ad_gamma, census_scale);
+	}
+}
+
+#ifdef DS_HAVE_AVX512
+DS_TARGET_AVX512
+static void cost_row_avx512(const unsigned char *ref_row, const unsigned long long int *ref_cen_row, const unsigned char *targ_line, const unsigned long long int *targ_cen_line,
+	int base, int base_step, const unsigned short *first_row, float *out, int width, int max_disparity, float ad_gamma, float census_scale){
+
+	__m256 ad_gamma_v = _mm256_set1_ps(ad_gamma), census_scale_v = _mm256_set1_ps(census_scale);
+	int vector_end = max_disparity & ~7;
+
+	for (int image_col = 0; image_col < width; image_col++, base += base_step, out += max_disparity){
+		__m128i ref_pix = _mm_set1_epi8((char)ref_row[image_col]);
+		__m512i ref_cen = _mm512_set1_epi64((long long)ref_cen_row[image_col]);
+
+		int pix_base = base + (first_row ? first_row[image_col] : 0);
+		const unsigned char *targ = targ_line + pix_base;
+		const unsigned long long int *targ_cen = targ_cen_line + pix_base;
+
+		//VPOPCNTQ counts all 8 census distances in one instruction
+		for (int disp = 0; disp < vector_end; disp += 8){
+			__m512i distance = _mm512_popcnt_epi64(_mm512_xor_si512(ref_cen, _mm512_loadu_si512((const void*)(targ_cen + disp))));
+			cost_step_avx2(_mm512_cvtepi64_epi32(distance), ref_pix, targ + disp, out + disp, ad_gamma_v, census_scale_v);
+		}
+
+		cost_pixel_scalar(ref_row[image_col], ref_cen_row[image_col], targ, targ_cen, out, vector_end, max_disparity, ad_gamma, census_scale);
+	}
+}
+#endif
+
+//Blended AD + census cost of one row, out[col][disparity]. With first_row each pixel's candidates start first_row[col]
+//past min_disparity instead of at it
+static void cost_row(const unsigned char *ref_row, const unsigned long long int *ref_cen_row, const unsigned char *targ_line, const unsigned long long int *targ_cen_line,
+	bool left_to_right, const unsigned short *first_row, float *out, int width, int min_disparity, int max_disparity, float ad_gamma, float census_gamma){
+
+	int base = (left_to_right ? width - 1 : 0) + min_disparity;
+	int base_step = left_to_right ? -1 : 1;
+	float census_scale = census_gamma / 64.0f;
+
+#ifdef DS_HAVE_AVX512
+	if (has_vpopcntdq){
+		cost_row_avx512(ref_row, ref_cen_row, targ_line, targ_cen_line, base, base_step, first_row, out, width, max_disparity, ad_gamma, census_scale);
+		return;
+	}
+#endif
+	if (has_avx2)
+		cost_row_avx2(ref_row, ref_cen_row, targ_line, targ_cen_line, base, base_step, first_row, out, width, max_disparity, ad_gamma, census_scale);
+	else
+		cost_row_scalar(ref_row, ref_cen_row, targ_line, targ_cen_line, base, base_step, first_row, out, width, max_disparity, ad_gamma, census_scale);
+}
+
+//Integer weights of the fixed-point cost, which is the float cost scaled by 255 * 64: AD (0..255) and the census
+//distance (0..64) are exact and their blend stays below 2^15. Gammas are clamped to [0, 1] so the cost fits its uint16
+static inline void fixed_cost_weights(float ad_gamma, float census_gamma, int &ad_weight, int &census_weight){
+	ad_weight = (int)(std::min(std::max(ad_gamma, 0.0f), 1.0f) * 64.0f + 0.5f);
+	census_weight = (int)(std::min(std::max(census_gamma, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static inline void fixed_cost_pixel_scalar(int ref, unsigned long long int ref_cen, const unsigned char *targ, const unsigned long long int *targ_cen,
+	unsigned short *out, int first, int max_disparity, int ad_weight, int census_weight){
+
+	for (int disp = first; disp < max_disparity; disp++)
+		out[disp] = (unsigned short)(abs(ref - targ[disp]) * ad_weight + popcount64(ref_cen ^ targ_cen[disp]) * census_weight);
+}
+
+static void fixed_cost_row_scalar(const unsigned char *ref_row, const unsigned long long int *ref_cen_row, const unsigned char *targ_line, const unsigned long long int *targ_cen_line,
+	int base, int base_step, const unsigned short *first_row, unsigned short *out, int width, int max_disparity, int ad_weight, int census_weight){
+
+	for (int image_col = 0; image_col < width; image_col++, base += base_step, out += max_disparity){
+		int pix_base = base + (first_row ? first_row[image_col] : 0);
+		fixed_cost_pixel_scalar(ref_row[image_col], ref_cen_row[image_col], targ_line + pix_base, targ_cen_line + pix_base, out, 0, max_disparity, ad_weight, census_weight);
+	}
+}
+
+//Blends 8 disparities with one pmaddwd: each dword holds (AD, census distance) as two words, weights as (ad_weight, census_weight)
+DS_TARGET_AVX2
+static inline void fixed_cost_step_avx2(__m256i census_counts, __m128i ref_pix, const unsigned char *targ, unsigned short *out, __m256i weights){
+	__m128i targ_pix = _mm_loadl_epi64((const __m128i*)targ);
+	__m128i ad = _mm_or_si128(_mm_subs_epu8(ref_pix, targ_pix), _mm_subs_epu8(targ_pix, ref_pix));
+
+	__m256i pairs = _mm256_or_si256(_mm256_cvtepu8_epi32(ad), _mm256_slli_epi32(census_counts, 16));
+	__m256i cost = _mm256_madd_epi16(pairs, weights);
+
+	__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(cost, cost), 0x08);
+	_mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(packed));
+}
+
+DS_TARGET_AVX2
+static void fixed_cost_row_avx2(const unsigned char *ref_row, const unsigned long long int *ref_cen_row, const unsigned char *targ_line, const unsigned long long int *targ_cen_line,
+	int base, int base_step, const unsigned short *first_row, unsigned short *out, int width, int max_disparity, int ad_weight, int census_weight){
+
+	const __m256i interleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	__m256i weights = _mm256_set1_epi32(ad_weight | (census_weight << 16));
+	int vector_end = max_disparity & ~7;
+
+	for (int image_col = 0; image_col < width; image_col++, base += base_step, out += max_disparity){
+		__m128i ref_pix = _mm_set1_epi8((char)ref_row[image_col]);
+		__m256i ref_cen = _mm256_set1_epi64x((long long)ref_cen_row[image_col]);
+
+		int pix_base = base + (first_row ? first_row[image_col] : 0);
+		const unsigned char *targ = targ_line + pix_base;
+		const unsigned long long int *targ_cen = targ_cen_line + pix_base;
+
+		for (int disp = 0; disp < vector_end; disp += 8){
+			__m256i count_a = popcount_epi64_avx2(_mm256_xor_si256(ref_cen, _mm256_loadu_si256((const __m256i*)(targ_cen + disp))));
+			__m256i count_b = popcount_epi64_avx2(_mm256_xor_si256(ref_cen, _mm256_loadu_si256((const __m256i*)(targ_cen + disp + 4))));
+			__m256i counts = _mm256_permutevar8x32_epi32(_mm256_or_si256(count_a, _mm256_slli_epi64(count_b, 32)), interleave);
+
+			fixed_cost_step_avx2(counts, ref_pix, targ + disp, out + disp, weights);
+		}
+
+		fixed_cost_pixel_scalar(ref_row[image_col], ref_cen_row[image_col], targ, targ_cen, out, vector_end, max_disparity, ad_weight, census_weight);
+	}
+}
+
+#ifdef DS_HAVE_AVX512
+DS_TARGET_AVX512
+static void fixed_cost_row_avx512(const unsigned char *ref_row, const unsigned long long int *ref_cen_row, const unsigned char *targ_line, const unsigned long long int *targ_cen_line,
+	int base, int base_step, const unsigned short *first_row, unsigned short *out, int width, int max_disparity, int ad_weight, int census_weight){
+
+	__m256i weights = _mm256_set1_epi32(ad_weight | (census_weight << 16));
+	int vector_end = max_disparity & ~7;
+
+	for (int image_col = 0; image_col < width; image_col++, base += base_step, out += max_disparity){
+		__m128i ref_pix = _mm_set1_epi8((char)ref_row[image_col]);
+		__m512i ref_cen = _mm512_set1_epi64((long long)ref_cen_row[image_col]);
+
+		int pix_base = base + (first_row ? first_row[image_col] : 0);
+		const unsigned char *targ = targ_line + pix_base;
+		const unsigned long long int *targ_cen = targ_cen_line + pix_base;
+
+		for (int disp = 0; disp < vector_end; disp += 8){
+			__m512i distance = _mm512_popcnt_epi64(_mm512_xor_si512(ref_cen, _mm512_loadu_si512((const void*)(targ_cen + disp))));
+			fixed_cost_step_avx2(_mm512_cvtepi64_epi32(distance), ref_pix, targ + disp, out + disp, weights);
+		}
+
+		fixed_cost_pixel_scalar(ref_row[image_col], ref_cen_row[image_col], targ, targ_cen, out, vector_end, max_disparity, ad_weight, census_weight);
+	}
+}
+#endif
+
+//Fixed-point matching cost of one row, out[col][disparity], half the bytes of the float cost
+static void fixed_cost_row(const unsigned char *ref_row, const unsigned long long int *ref_cen_row, const unsigned char *targ_line, const unsigned long long int *targ_cen_line,
+	bool left_to_right, const unsigned short *first_row, unsigned short *out, int width, int min_disparity, int max_disparity, int ad_weight, int census_weight){
+
+	int base = (left_to_right ? width - 1 : 0) + min_disparity;
+	int base_step = left_to_right ? -1 : 1;
+
+#ifdef DS_HAVE_AVX512
+	if (has_vpopcntdq){
+		fixed_cost_row_avx512(ref_row, ref_cen_row, targ_line, targ_cen_line, base, base_step, first_row, out, width, max_disparity, ad_weight, census_weight);
+		return;
+	}
+#endif
+	if (has_avx2)
+		fixed_cost_row_avx2(ref_row, ref_cen_row, targ_line, targ_cen_line, base, base_step, first_row, out, width, max_disparity, ad_weight, census_weight);
+	else
+		fixed_cost_row_scalar(ref_row, ref_cen_row, targ_line, targ_cen_line, base, base_step, first_row, out, width, max_disparity, ad_weight, census_weight);
+}
+
+//Running row sum of a row of costs
+static void integrate_row(const float *costs, float *row_sums, int width, int max_disparity){
+	memcpy(row_sums, costs, max_disparity * sizeof(float));
+
+	for (int image_col = 1; image_col < width; image_col++){
+		const float *pix_cost = costs + (size_t)image_col * max_disparity;
+		const float *prev = row_sums + (size_t)(image_col - 1) * max_disparity;
+		float *curr = row_sums + (size_t)image_col * max_disparity;
+
+		int d = 0;
+		for (; d + 4 <= max_disparity; d += 4) _mm_storeu_ps(curr + d, _mm_add_ps(_mm_loadu_ps(prev + d), _mm_loadu_ps(pix_cost + d)));
+		for (; d < max_disparity; d++) curr[d] = prev[d] + pix_cost[d];
+	}
+}
+
+//Fixed-point costs are widened to 32 bits
+static void integrate_row(const unsigned short *costs, unsigned int *row_sums, int width, int max_disparity){
+	const __m128i zero = _mm_setzero_si128();
+
+	for (int d = 0; d < max_disparity; d++) row_sums[d] = costs[d];
+
+	for (int image_col = 1; image_col < width; image_col++){
+		const unsigned short *pix_cost = costs + (size_t)image_col * max_disparity;
+		const unsigned int *prev = row_sums + (size_t)(image_col - 1) * max_disparity;
+		unsigned int *curr = row_sums + (size_t)image_col * max_disparity;
+
+		int d = 0;
+		for (; d + 8 <= max_disparity; d += 8){
+			__m128i cost = _mm_loadu_si128((const __m128i*)(pix_cost + d));
+			_mm_storeu_si128((__m128i*)(curr + d), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(prev + d)), _mm_unpacklo_epi16(cost, zero)));
+			_mm_storeu_si128((__m128i*)(curr + d + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(prev + d + 4)), _mm_unpackhi_epi16(cost, zero)));
+		}
+		for (; d < max_disparity; d++) curr[d] = prev[d] + pix_cost[d];
+	}
+}
+
+//Everything the per-row cost engines need. min_disparity and max_disparity are the chunk of candidates being matched,
+//range_min and range_disparities the whole range the winners are picked from. Winners whose cost is not below
+//uniqueness_ratio times the best cost outside their neighbourhood are rejected, a ratio of 1 or more keeps them all.
+//With left_first and right_first every pixel's candidates start at its own entry instead, see windowed
+struct match_rows{
+	const unsigned char *left, *right;
+	const unsigned long long int *left_census, *right_census;
+	const unsigned short *left_first, *right_first;
+	int width, min_disparity, max_disparity;
+	int range_min, range_disparities, subpixel_bits;
+	int candidate_end; //Past the largest disparity any pixel matches
+	float ad_gamma, census_gamma, uniqueness_ratio;
+	int ad_weight, census_weight;
+
+	match_rows(const unsigned char *left, const unsigned char *right, const unsigned long long int *left_census, const unsigned long long int *right_census,
+		int width, int min_disparity, int max_disparity, float ad_gamma, float census_gamma, float uniqueness_ratio){
+
+		this->left = left;
+		this->right = right;
+		this->left_census = left_census;
+		this->right_census = right_census;
+		this->left_first = this->right_first = NULL;
+		this->width = width;
+		this->min_disparity = range_min = min_disparity;
+		this->max_disparity = range_disparities = max_disparity;
+		this->subpixel_bits = host_subpixel_bits(min_disparity, max_disparity);
+		this->candidate_end = min_disparity + max_disparity;
+		this->ad_gamma = ad_gamma;
+		this->census_gamma = census_gamma;
+		this->uniqueness_ratio = uniqueness_ratio;
+		fixed_cost_weights(ad_gamma, census_gamma, ad_weight, census_weight);
+	}
+
+	//Same rows restricted to the given chunk of the range
+	match_rows chunk(int chunk_begin, int chunk_end) const{
+		match_rows rows = *this;
+		rows.min_disparity = range_min + chunk_begin;
+		rows.max_disparity = chunk_end - chunk_begin;
+		return rows;
+	}
+
+	//Same rows matching window.size candidates per pixel from the window's first candidates. Candidates, volumes and
+	//winners then run over the offset into each pixel's window; the output keeps the subpixel bits of the whole range
+	match_rows windowed(const host_search_window &window) const{
+		match_rows rows = *this;
+		rows.left_first = window.left_first;
+		rows.right_first = window.right_first;
+		rows.min_disparity = rows.range_min = 0;
+		rows.max_disparity = rows.range_disparities = window.size;
+		return rows;
+	}
+
+	bool unique() const{ return uniqueness_ratio < 1.0f; }
+	bool is_windowed() const{ return left_first || right_first; }
+};
+
+//Per-pixel cost type behind each row sum type
+template <typename T> struct cost_of{};
+template <> struct cost_of<float>{ typedef float type; };
+template <> struct cost_of<unsigned int>{ typedef unsigned short type; };
+
+//Per-thread buffers of the row engines
+template <typename T>
+struct row_scratch{
+	typedef typename cost_of<T>::type C;
+
+	int line_length;
+	std::vector<unsigned char> targ_line;
+	std::vector<unsigned long long int> targ_cen_line;
+	std::vector<C> costs, sheared, border;
+	std::vector<T> row_sums;
+
+	row_scratch(const match_rows &rows) :
+		line_length(rows.width + rows.candidate_end + 8), targ_line(line_length), targ_cen_line(line_length),
+		costs((size_t)rows.width * rows.max_disparity), sheared(share_costs && !rows.is_windowed() ? (size_t)rows.width * rows.max_disparity : 0), border(rows.width),
+		row_sums((size_t)rows.width * rows.max_disparity){}
+};
+
+//Matching cost of one row in either direction, in float or fixed point depending on the output type
+template <typename T>
+static void costs_of(const match_rows &rows, int image_row, bool left_to_right, row_scratch<T> &scratch, float *out){
+	const unsigned char *ref_im = left_to_right ? rows.left : rows.right, *targ_im = left_to_right ? rows.right : rows.left;
+	const unsigned long long int *ref_census = left_to_right ? rows.left_census : rows.right_census, *targ_census = left_to_right ? rows.right_census : rows.left_census;
+
+	orient_target_row(targ_im + image_row * rows.width, targ_census + image_row * rows.width, scratch.targ_line.data(), scratch.targ_cen_line.data(),
+		left_to_right, rows.width, scratch.line_length);
+
+	const unsigned short *first = left_to_right ? rows.left_first : rows.right_first;
+
+	cost_row(ref_im + image_row * rows.width, ref_census + image_row * rows.width, scratch.targ_line.data(), scratch.targ_cen_line.data(),
+		left_to_right, first ? first + image_row * rows.width : NULL, out, rows.width, rows.min_disparity, rows.max_disparity, rows.ad_gamma, rows.census_gamma);
+}
+
+template <typename T>
+static void costs_of(const match_rows &rows, int image_row, bool left_to_right, row_scratch<T> &scratch, unsigned short *out){
+	const unsigned char *ref_im = left_to_right ? rows.left : rows.right, *targ_im = left_to_right ? rows.right : rows.left;
+	const unsigned long long int *ref_census = left_to_right ? rows.left_census : rows.right_census, *targ_census = left_to_right ? rows.right_census : rows.left_census;
+
+	orient_target_row(targ_im + image_row * rows.width, targ_census + image_row * rows.width, scratch.targ_line.data(), scratch.targ_cen_line.data(),
+		left_to_right, rows.width, scratch.line_length);
+
+	const unsigned short *first = left_to_right ? rows.left_first : rows.right_first;
+
+	fixed_cost_row(ref_im + image_row * rows.width, ref_census + image_row * rows.width, scratch.targ_line.data(), scratch.targ_cen_line.data(),
+		left_to_right, first ? first + image_row * rows.width : NULL, out, rows.width, rows.min_disparity, rows.max_disparity, rows.ad_weight, rows.census_weight);
+}
+
+//Cost of each right pixel of a row against the zero border past the left image, what the device reads for candidates
+//outside the target texture
+static void border_costs(const match_rows &rows, int image_row, float *border){
+	float census_scale = rows.census_gamma / 64.0f;
+
+	for (int image_col = 0; image_col < rows.width; image_col++){
+		float ad_cost = (rows.right[image_row * rows.width + image_col] / 255.0f) * rows.ad_gamma;
+		float census_cost = popcount64(rows.right_census[image_row * rows.width + image_col]) * census_scale;
+		border[image_col] = ad_cost + census_cost;
+	}
+}
+
+static void border_costs(const match_rows &rows, int image_row, unsigned short *border){
+	for (int image_col = 0; image_col < rows.width; image_col++){
+		border[image_col] = (unsigned short)(rows.right[image_row * rows.width + image_col] * rows.ad_weight
+			+ popcount64(rows.right_census[image_row * rows.width + image_col]) * rows.census_weight);
+	}
+}
+
+//Right-reference costs of one row from its left-reference costs, C_R(x, d) = C_L(x + min_disparity + d, d): the
+//candidates of a right pixel run down a diagonal of the left row. Candidates past the last column are border costs
+template <typename C>
+static void shear_row(const match_rows &rows, const C *cost_row, int image_row, C *border, C *out){
+	int width = rows.width, min_disparity = rows.min_disparity, max_disparity = rows.max_disparity;
+
+	//Blocks of 16 disparities keep the diagonals being written within a few cache lines
+	for (int block = 0; block < max_disparity; block += 16){
+		int block_end = std::min(block + 16, max_disparity);
+
+		for (int image_col = block + min_disparity; image_col < width; image_col++){
+			const C *pix_cost = cost_row + (size_t)image_col * max_disparity;
+			C *diagonal = out + (size_t)(image_col - min_disparity) * max_disparity;
+
+			int reach = std::min(block_end, image_col - min_disparity + 1);
+			for (int d = block; d < reach; d++) diagonal[d - (ptrdiff_t)d * max_disparity] = pix_cost[d];
+		}
+	}
+
+	border_costs(rows, image_row, border);
+
+	for (int image_col = std::max(0, width - min_disparity - max_disparity); image_col < width; image_col++){
+		C *pix_out = out + (size_t)image_col * max_disparity;
+		for (int d = std::max(0, width - min_disparity - image_col); d < max_disparity; d++) pix_out[d] = border[image_col];
+	}
+}
+
+//Arm-bounded horizontal differences of one row of running row sums, stacked onto the aggregated row above when given
+template <typename T>
+static void horizontal_row(const T *row_sums, const uchar4 *arm_row, const T *above, T *out, int width, int max_disparity){
+	for (int image_col = 0; image_col < width; image_col++){
+		uchar4 pix_arm = arm_row[image_col];
+
+		//The right arm may reach one past the last column, clamp instead of reading into the next row
+		int right_limit = std::min(image_col + pix_arm.w, width - 1);
+		int left_limit = image_col - pix_arm.z - 1;
+
+		T *pix_out = out + (size_t)image_col * max_disparity;
+		sub_costs(pix_out, row_sums + (size_t)right_limit * max_disparity, left_limit >= 0 ? row_sums + (size_t)left_limit * max_disparity : NULL, max_disparity);
+
+		if (above) add_costs(pix_out, above + (size_t)image_col * max_disparity, max_disparity);
+	}
+}
+
+//Winner of one pixel's vertical box sum, with the two neighbours the subpixel parabola needs and the best cost outside
+//the winner and those neighbours (second), which the uniqueness test compares against: the neighbours of a winner
+//are always close to it, and the confidence measure. The first and last candidate costs link picks of neighbouring chunks
+template <typename T>
+struct disparity_pick{
+	int disp;
+	T best, second, prev, next;
+	T first, last;
+};
+
+//Box sums are down - up (down alone when the box starts at the first summed row), consumed as they are formed: only
+//the running minimum and the winner's neighbours are kept, no cost buffer is written. With ranked the second best is
+//kept too; a candidate only joins it once the next one has shown it is not the left neighbour of a new winner
+template <bool ranked, typename T>
+static inline disparity_pick<T> box_wta(const T *down, const T *up, int max_disparity){
+	disparity_pick<T> pick;
+	pick.disp = 0;
+	pick.best = pick.prev = pick.next = pick.first = down[0] - (up ? up[0] : 0);
+	pick.second = std::numeric_limits<T>::max();
+
+	T last = pick.best;
+	for (int d = 1; d < max_disparity; d++){
+		T cost = down[d] - (up ? up[d] : 0);
+
+		if (cost < pick.best){
+			if (ranked){
+				//The old winner and its neighbours leave the excluded window, except a right neighbour still pending
+				if (pick.disp > 0) pick.second = std::min(pick.second, pick.prev);
+				if (pick.disp < d - 1) pick.second = std::min(pick.second, pick.best);
+				if (pick.disp + 1 < d - 1) pick.second = std::min(pick.second, pick.next);
+			}
+			pick.best = pick.next = cost;
+			pick.prev = last;
+			pick.disp = d;
+		}
+		else{
+			if (ranked && d - 1 > pick.disp + 1) pick.second = std::min(pick.second, last);
+			if (d == pick.disp + 1) pick.next = cost;
+		}
+		last = cost;
+	}
+	if (ranked && max_disparity - 1 > pick.disp + 1) pick.second = std::min(pick.second, last);
+	pick.last = last;
+
+	return pick;
+}
+
+//Folds the pick of the chunk starting at candidate offset into the winner of the chunks before it. Ties keep the
+//earlier winner, so the result is the pick over the joined range. The losing side offers its best to the second best,
+//or its best outside the winner's neighbour when the two winners meet at the chunk border
+template <typename T>
+static inline void merge_pick(disparity_pick<T> &carry, disparity_pick<T> pick, int offset){
+	bool adjacent = carry.disp == offset - 1 && pick.disp == 0;
+	if (carry.disp == offset - 1) carry.next = pick.first;
+
+	if (pick.best < carry.best){
+		pick.second = std::min(pick.second, adjacent ? std::min(carry.second, carry.prev) : carry.best);
+		if (pick.disp == 0) pick.prev = carry.last;
+		pick.disp += offset;
+		carry = pick;
+	}
+	else{
+		carry.second = std::min(carry.second, adjacent ? std::min(pick.second, pick.next) : pick.best);
+		carry.last = pick.last;
+	}
+}
+
+//One arm-bounded matching direction: its cross, where its horizontal aggregates go and its disparity map, either
+//subpixel (disp_im) or integer (integer_disp_im), with the confidence of each winner when confidence_im is given.
+//A direction without a map is not matched
+template <typename T>
+struct match_direction{
+	const uchar4 *arm_vol;
+	T *agg;
+	unsigned short *disp_im;
+	unsigned char *integer_disp_im;
+	unsigned char *confidence_im;
+	const unsigned short *window_first; //First candidate of each pixel when the rows are windowed, NULL otherwise
+	disparity_pick<T> *carry; //Winners so far when the range is matched in chunks, NULL otherwise
+
+	bool enabled() const{ return disp_im || integer_disp_im; }
+};
+
+template <typename T>
+static inline match_direction<T> make_direction(const uchar4 *arm_vol, T *agg, unsigned short *disp_im){
+	match_direction<T> dir = { arm_vol, agg, disp_im, NULL, NULL, NULL, NULL };
+	return dir;
+}
+
+template <typename T>
+static inline match_direction<T> make_direction(const uchar4 *arm_vol, T *agg, unsigned char *disp_im){
+	match_direction<T> dir = { arm_vol, agg, NULL, disp_im, NULL, NULL, NULL };
+	return dir;
+}
+
+//Confidence of a winner in [0, 255]: the harmonic mean of its margin to the second best, 1 - best / second, and the
+//curvature of the cost curve around it, (prev + next - 2 * best) / (prev + next). Either one near zero makes it low.
+//A winner at either end of the max_disparity candidates has one neighbour, its curvature is taken on that side only
+template <typename T>
+static inline unsigned char pick_confidence(const disparity_pick<T> &pick, int max_disparity){
+	float best = (float)pick.best, second = (float)pick.second, sides = 0.0f, centre = 0.0f;
+	if (pick.disp > 0){ sides += (float)pick.prev; centre += best; }
+	if (pick.disp < max_disparity - 1){ sides += (float)pick.next; centre += best; }
+
+	float margin = second > 0 ? 1.0f - best / second : 0.0f;
+	float curvature = sides > 0 ? (sides - centre) / sides : 0.0f;
+
+	return margin + curvature > 0 ? (unsigned char)(510.0f * margin * curvature / (margin + curvature) + 0.5f) : 0;
+}
+
+//Writes the winner of one pixel, or folds it into the pixel's carried pick while chunks of the range remain
+template <bool ranked, typename T>
+static inline void pick_disparity(const match_rows &rows, disparity_pick<T> pick, disparity_pick<T> *carry, const match_direction<T> &dir, size_t pixel){
+	if (carry){
+		int offset = rows.min_disparity - rows.range_min;
+		if (offset == 0) *carry = pick;
+		else merge_pick(*carry, pick, offset);
+
+		if (offset + rows.max_disparity < rows.range_disparities) return;
+		pick = *carry;
+	}
+
+	if (ranked && rows.unique() && (float)pick.best > rows.uniqueness_ratio * (float)pick.second){
+		if (dir.integer_disp_im) dir.integer_disp_im[pixel] = OUTLIER;
+		else dir.disp_im[pixel] = OUTLIER;
+		if (dir.confidence_im) dir.confidence_im[pixel] = 0;
+		return;
+	}
+
+	if (ranked && dir.confidence_im) dir.confidence_im[pixel] = pick_confidence(pick, rows.range_disparities);
+
+	int first = rows.range_min + (dir.window_first ? dir.window_first[pixel] : 0);
+
+	if (dir.integer_disp_im)
+		dir.integer_disp_im[pixel] = (unsigned char)(first + pick.disp);
+	else
+		dir.disp_im[pixel] = subpixel_disparity(pick.prev, pick.best, pick.next, pick.disp, first, rows.range_disparities, rows.subpixel_bits);
+}
+
+//Vertical aggregation and winner-take-all of one row from a ring of ring_rows rows of running column sums
+//starting at first_row. Whether winners are carried and whether the second best is tracked (for the uniqueness test
+//and the confidence map) are template arguments to keep the branches out of the pixel loop
+template <bool carried, bool ranked, typename T>
+static void vertical_wta_row(const match_rows &rows, match_direction<T> dir, const T *ring, int ring_rows, int first_row, int image_row){
+	int width = rows.width, max_disparity = rows.max_disparity;
+	size_t row_stride = (size_t)width * max_disparity;
+	const uchar4 *arm_row = dir.arm_vol + image_row * width;
+
+	for (int image_col = 0; image_col < width; image_col++){
+		uchar4 pix_arm = arm_row[image_col];
+
+		int down_lim = image_row + pix_arm.y;
+		int up_lim = image_row - pix_arm.x - 1;
+
+		const T *down = ring + (down_lim % ring_rows) * row_stride + (size_t)image_col * max_disparity;
+		const T *up = up_lim >= first_row ? ring + (up_lim % ring_rows) * row_stride + (size_t)image_col * max_disparity : NULL;
+
+		size_t pixel = (size_t)image_row * width + image_col;
+		pick_disparity<ranked>(rows, box_wta<ranked>(down, up, max_disparity), carried ? dir.carry + pixel : NULL, dir, pixel);
+	}
+}
+
+//Vertical aggregation and winner-take-all over a full volume of horizontal aggregates. The running column sum is
+//formed in place only as far down as the current row's arms reach, so each band of columns is swept once and the
+//rows a box spans are still in cache when the winner is picked
+template <bool carried, bool ranked, typename T>
+static void vertical_wta(const match_rows &rows, match_direction<T> dir, int height, int threads){
+	int width = rows.width, max_disparity = rows.max_disparity;
+	T *agg_vol = dir.agg;
+	const uchar4 *arm_vol = dir.arm_vol;
+
+	host_parallel_for(width, threads, [=](int col_begin, int col_end){
+		size_t row_stride = (size_t)width * max_disparity;
+		int span = (col_end - col_begin) * max_disparity;
+		int summed_row = 0;
+
+		for (int image_row = 0; image_row < height; image_row++){
+			const uchar4 *arm_row = arm_vol + image_row * width;
+
+			int needed_row = image_row;
+			for (int image_col = col_begin; image_col < col_end; image_col++) needed_row = std::max(needed_row, image_row + arm_row[image_col].y);
+			needed_row = std::min(needed_row, height - 1);
+
+			for (; summed_row < needed_row; summed_row++){
+				T *out = agg_vol + (summed_row + 1) * row_stride + (size_t)col_begin * max_disparity;
+				add_costs(out, out - row_stride, span);
+			}
+
+			for (int image_col = col_begin; image_col < col_end; image_col++){
+				uchar4 pix_arm = arm_row[image_col];
+
+				int down_lim = image_row + pix_arm.y;
+				int up_lim = image_row - pix_arm.x - 1;
+
+				const T *down = agg_vol + down_lim * row_stride + (size_t)image_col * max_disparity;
+				const T *up = up_lim >= 0 ? agg_vol + up_lim * row_stride + (size_t)image_col * max_disparity : NULL;
+
+				size_t pixel = (size_t)image_row * width + image_col;
+				pick_disparity<ranked>(rows, box_wta<ranked>(down, up, max_disparity), carried ? dir.carry + pixel : NULL, dir, pixel);
+			}
+		}
+	});
+}
+
+//vertical_wta_row and vertical_wta instantiated for the direction and range at hand, nothing for a disabled direction
+template <typename T>
+static void vertical_wta_row_of(const match_rows &rows, match_direction<T> dir, const T *ring, int ring_rows, int first_row, int image_row){
+	if (!dir.enabled()) return;
+	bool ranked = rows.unique() || dir.confidence_im;
+
+	if (dir.carry){
+		if (ranked) vertical_wta_row<true, true>(rows, dir, ring, ring_rows, first_row, image_row);
+		else vertical_wta_row<true, false>(rows, dir, ring, ring_rows, first_row, image_row);
+	}
+	else{
+		if (ranked) vertical_wta_row<false, true>(rows, dir, ring, ring_rows, first_row, image_row);
+		else vertical_wta_row<false, false>(rows, dir, ring, ring_rows, first_row, image_row);
+	}
+}
+
+template <typename T>
+static void vertical_wta_of(const match_rows &rows, match_direction<T> dir, int height, int threads){
+	if (!dir.enabled()) return;
+	bool ranked = rows.unique() || dir.confidence_im;
+
+	if (dir.carry){
+		if (ranked) vertical_wta<true, true>(rows, dir, height, threads);
+		else vertical_wta<true, false>(rows, dir, height, threads);
+	}
+	else{
+		if (ranked) vertical_wta<false, true>(rows, dir, height, threads);
+		else vertical_wta<false, false>(rows, dir, height, threads);
+	}
+}
+
+//Horizontal aggregation of one row in both directions. Without vector cost engines the cost is evaluated once in the
+//left reference and sheared for the right one, unless the rows are windowed. Each output row is stacked onto the one above when given, as the ring
+//of the streaming path needs. Without right_out only the left direction is aggregated
+template <typename T>
+static void horizontal_pair_row(const match_rows &rows, int image_row, row_scratch<T> &scratch,
+	const uchar4 *left_arm_row, const T *left_above, T *left_out, const uchar4 *right_arm_row, const T *right_above, T *right_out){
+
+	int width = rows.width, max_disparity = rows.max_disparity;
+
+	costs_of(rows, image_row, true, scratch, scratch.costs.data());
+
+	integrate_row(scratch.costs.data(), scratch.row_sums.data(), width, max_disparity);
+	horizontal_row(scratch.row_sums.data(), left_arm_row, left_above, left_out, width, max_disparity);
+	if (!right_out) return;
+
+	if (share_costs && !rows.is_windowed()){
+		shear_row(rows, scratch.costs.data(), image_row, scratch.border.data(), scratch.sheared.data());
+		integrate_row(scratch.sheared.data(), scratch.row_sums.data(), width, max_disparity);
+	}
+	else{
+		costs_of(rows, image_row, false, scratch, scratch.costs.data());
+		integrate_row(scratch.costs.data(), scratch.row_sums.data(), width, max_disparity);
+	}
+	horizontal_row(scratch.row_sums.data(), right_arm_row, right_above, right_out, width, max_disparity);
+}
+
+//Full-volume matching of both directions, or of the left one alone when the right has no map. Cost and row sums only
+//live for one row, their arm-bounded differences go to the aggregate volumes which the fused vertical pass then sums
+//in place
+template <typename T>
+static void match_pair(const match_rows &rows, match_direction<T> left, match_direction<T> right, int height, int threads){
+	int width = rows.width, max_disparity = rows.max_disparity;
+	size_t row_stride = (size_t)width * max_disparity;
+	bool pair = right.enabled();
+
+	host_parallel_for(height, threads, [=, &rows](int row_begin, int row_end){
+		row_scratch<T> scratch(rows);
+
+		for (int image_row = row_begin; image_row < row_end; image_row++){
+			horizontal_pair_row(rows, image_row, scratch,
+				left.arm_vol + image_row * width, (const T*)NULL, left.agg + image_row * row_stride,
+				pair ? right.arm_vol + image_row * width : NULL, (const T*)NULL, pair ? right.agg + image_row * row_stride : NULL);
+		}
+	});
+
+	if (!pair){
+		vertical_wta_of(rows, left, height, threads);
+		return;
+	}
+
+	//The directions are independent from here on, each gets its own half of the threads
+	host_parallel_pair(threads,
+		[=, &rows](int group_threads){ vertical_wta_of(rows, left, height, group_threads); },
+		[=, &rows](int group_threads){ vertical_wta_of(rows, right, height, group_threads); });
+}
+
+//Ring-buffered matching of both directions (or the left alone), shared by the float and fixed-point streaming paths
+template <typename T>
+static void stream_match(const match_rows &rows, T *band_vol, match_direction<T> left, match_direction<T> right, int max_arm_length, int height, int threads){
+	int width = rows.width, max_disparity = rows.max_disparity;
+
+	//Arms never exceed max_arm_length except for the 2 pixel minimum cross_construct falls back to
+	int reach = std::max(max_arm_length, 2);
+	int ring_rows = 2 * reach + 2;
+	int bands = std::max(1, std::min(threads, height / ring_rows));
+	size_t row_stride = (size_t)width * max_disparity;
+	bool pair = right.enabled();
+
+	host_parallel_for(bands, bands, [=, &rows](int band_begin, int band_end){
+		row_scratch<T> scratch(rows);
+
+		for (int band = band_begin; band < band_end; band++){
+			T *left_ring = band_vol + (size_t)band * 2 * ring_rows * row_stride;
+			T *right_ring = left_ring + ring_rows * row_stride;
+
+			int row_begin = (int)((long long)height * band / bands);
+			int row_end = (int)((long long)height * (band + 1) / bands);
+
+			//Running column sums restart at the first row any output row of this band can reach
+			int first_row = std::max(0, row_begin - reach);
+			int next_row = first_row;
+
+			for (int image_row = row_begin; image_row < row_end; image_row++){
+				int needed_row = std::min(height - 1, image_row + reach);
+
+				//Slide the band down: cost, horizontal aggregation and column sum for every row the output row can reach
+				for (; next_row <= needed_row; next_row++){
+					size_t slot = (next_row % ring_rows) * row_stride;
+					size_t above = next_row > first_row ? ((next_row - 1) % ring_rows) * row_stride : 0;
+
+					horizontal_pair_row(rows, next_row, scratch,
+						left.arm_vol + next_row * width, next_row > first_row ? left_ring + above : NULL, left_ring + slot,
+						pair ? right.arm_vol + next_row * width : NULL, next_row > first_row ? right_ring + above : NULL, pair ? right_ring + slot : NULL);
+				}
+
+				vertical_wta_row_of(rows, left, left_ring, ring_rows, first_row, image_row);
+				vertical_wta_row_of(rows, right, right_ring, ring_rows, first_row, image_row);
+			}
+		}
+	});
+}
+
+//Runs match_chunk(chunk_rows, left, right) over chunks of at most HOST_DISPARITY_CHUNK candidates, each pixel's
+//winner carried from chunk to chunk, so the volumes only ever hold one chunk
+template <typename T, typename F>
+static void match_chunks(const match_rows &rows, match_direction<T> left, match_direction<T> right, int height, F match_chunk){
+	int chunk = host_disparity_chunk(rows.range_disparities);
+	if (chunk == rows.range_disparities){
+		match_chunk(rows, left, right);
+		return;
+	}
+
+	std::vector<disparity_pick<T> > left_carry((size_t)rows.width * height), right_carry(right.enabled() ? (size_t)rows.width * height : 0);
+	left.carry = left_carry.data();
+	right.carry = right_carry.data();
+
+	for (int chunk_begin = 0; chunk_begin < rows.range_disparities; chunk_begin += chunk)
+		match_chunk(rows.chunk(chunk_begin, std::min(chunk_begin + chunk, rows.range_disparities)), left, right);
+}
+
+/////////////////////////////////////////////////////////////////////////////Stages/////////////////////////////////////////////////////////////////////////////
+
+void host_census_transform(const unsigned char *input_im, unsigned long long int *output_census, int width, int height, int threads){
+
+	//Zero-bordered copy so every window load of a 32 pixel chunk stays inside the buffer
+	int stride = CENSUS_PAD + (width + CENSUS_CHUNK - 1) / CENSUS_CHUNK * CENSUS_CHUNK + CENSUS_PAD;
+	std::vector<unsigned char> padded((size_t)(height + 2 * CENSUS_PAD) * stride, 0);
+	for (int image_row = 0; image_row < height; image_row++)
+		memcpy(&padded[(size_t)(image_row + CENSUS_PAD) * stride + CENSUS_PAD], input_im + image_row * width, width);
+
+	//Window offsets in census bit order, the centre comparison (always zero) sits at positions 31 and 32
+	int offsets[64];
+	int position = 0;
+	for (int dy = -4; dy <= 4; dy++){
+		for (int dx = -3; dx <= 3; dx++){
+			if (dy == 0 && dx == 0) position += 2;
+			else offsets[position++] = dy * stride + dx;
+		}
+	}
+
+	const unsigned char *origin = &padded[(size_t)CENSUS_PAD * stride + CENSUS_PAD];
+
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		for (int image_row = row_begin; image_row < row_end; image_row++){
+			for (int image_col = 0; image_col < width; image_col += CENSUS_CHUNK){
+				const unsigned char *centre = origin + (size_t)image_row * stride + image_col;
+				int count = std::min(CENSUS_CHUNK, width - image_col);
+
+				if (has_avx2)
+					census_chunk_avx2(centre, offsets, output_census + image_row * width + image_col, count);
+				else
+					census_chunk_sse2(centre, offsets, output_census + image_row * width + image_col, count);
+			}
+		}
+	});
+}
+
+//Cross of planar images, one plane for gray arms or B, G and R planes for colour arms
+static void cross_construct_planes(const unsigned char *const *planes, int channels, uchar4 *arm_vol, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int width, int height, int threads){
+	//Arms are stored as uchar, longer scans would wrap
+	int steps = std::min(std::max(max_arm_length, 0), 255);
+
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		//Row copies with zero borders wide enough for a full scan from any vector of pixels, the texture border of the kernel
+		std::vector<unsigned char> padded(channels * (width + 2 * (steps + 1)), 0);
+		std::vector<unsigned char> left_limit(width), right_limit(width);
+		std::vector<unsigned char> up(width), down(width), left(width), right(width);
+
+		//A horizontal scan may step through image_col pixels to the left and width - image_col to the right
+		for (int image_col = 0; image_col < width; image_col++){
+			left_limit[image_col] = (unsigned char)std::min(image_col, 255);
+			right_limit[image_col] = (unsigned char)std::min(width - image_col, 255);
+		}
+
+		const unsigned char *rows[3], *centres[3];
+
+		for (int image_row = row_begin; image_row < row_end; image_row++){
+			for (int channel = 0; channel < channels; channel++){
+				unsigned char *centre = &padded[channel * (width + 2 * (steps + 1)) + steps + 1];
+				rows[channel] = planes[channel] + image_row * width;
+				memcpy(centre, rows[channel], width);
+				centres[channel] = centre;
+			}
+
+			//Vertical scans stop at the same row for the whole row, the step count bounds them
+			arm_lanes(rows, channels, -width, NULL, std::min(steps, image_row), arm_length, arm_threshold, strict_arm_threshold, up.data(), width);
+			arm_lanes(rows, channels, width, NULL, std::min(steps, height - 1 - image_row), arm_length, arm_threshold, strict_arm_threshold, down.data(), width);
+			arm_lanes(centres, channels, -1, left_limit.data(), steps, arm_length, arm_threshold, strict_arm_threshold, left.data(), width);
+			arm_lanes(centres, channels, 1, right_limit.data(), steps, arm_length, arm_threshold, strict_arm_threshold, right.data(), width);
+
+			for (int image_col = 0; image_col < width; image_col++){
+				uchar4 pix_arm;
+				pix_arm.x = up[image_col] == 0 ? (image_row - 2 >= 0 ? 2 : 0) : up[image_col];
+				pix_arm.y = down[image_col] == 0 ? (image_row + 2 < height ? 2 : 0) : down[image_col];
+				pix_arm.z = left[image_col] == 0 ? (image_col - 2 >= 0 ? 2 : 0) : left[image_col];
+				pix_arm.w = right[image_col] == 0 ? (image_col + 2 < width ? 2 : 0) : right[image_col];
+
+				arm_vol[image_row * width + image_col] = pix_arm;
+			}
+		}
+	});
+}
+
+void host_cross_construct(const unsigned char *input_im, uchar4 *arm_vol, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int width, int height, int threads){
+	cross_construct_planes(&input_im, 1, arm_vol, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, width, height, threads);
+}
+
+void host_cross_construct_bgr(const unsigned char *input_bgr, uchar4 *arm_vol, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int width, int height, int threads){
+	//Split the channels so a vector of pixels loads each of them with one read
+	size_t plane_size = (size_t)width * height;
+	std::vector<unsigned char> planar(3 * plane_size);
+	unsigned char *b = planar.data(), *g = b + plane_size, *r = g + plane_size;
+
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		for (size_t i = (size_t)row_begin * width; i < (size_t)row_end * width; i++){
+			b[i] = input_bgr[3 * i + 0];
+			g[i] = input_bgr[3 * i + 1];
+			r[i] = input_bgr[3 * i + 2];
+		}
+	});
+
+	const unsigned char *planes[3] = { b, g, r };
+	cross_construct_planes(planes, 3, arm_vol, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, width, height, threads);
+}
+
+void host_downsample(const unsigned char *input_im, unsigned char *output_im, int width, int height, int factor, int threads){
+	int out_width = width / factor, out_height = height / factor;
+	int area = factor * factor;
+
+	host_parallel_for(out_height, threads, [=](int row_begin, int row_end){
+		std::vector<int> sums(out_width);
+
+		for (int out_row = row_begin; out_row < row_end; out_row++){
+			std::fill(sums.begin(), sums.end(), 0);
+
+			//Column sums of the block rows first, so each input row is read once front to back
+			for (int block_row = 0; block_row < factor; block_row++){
+				const unsigned char *in_row = input_im + (size_t)(out_row * factor + block_row) * width;
+				for (int out_col = 0; out_col < out_width; out_col++)
+					for (int block_col = 0; block_col < factor; block_col++) sums[out_col] += in_row[out_col * factor + block_col];
+			}
+
+			for (int out_col = 0; out_col < out_width; out_col++)
+				output_im[(size_t)out_row * out_width + out_col] = (unsigned char)((sums[out_col] + area / 2) / area);
+		}
+	});
+}
+
+void host_mask_tiles(const unsigned char *mask, unsigned char *tiles, int tile, int width, int height, int threads){
+	int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+
+	host_parallel_for(tiles_y, threads, [=](int tile_row_begin, int tile_row_end){
+		for (int tile_row = tile_row_begin; tile_row < tile_row_end; tile_row++){
+			int row_end = std::min(tile_row * tile + tile, height);
+
+			for (int image_row = tile_row * tile; image_row < row_end; image_row++){
+				const unsigned char *mask_row = mask + (size_t)image_row * width;
+				for (int image_col = 0; image_col < width; image_col++)
+					if (mask_row[image_col]) tiles[tile_row * tiles_x + image_col / tile] = 1;
+			}
+		}
+	});
+}
+
+void host_dilate_tiles(unsigned char *tiles, int radius, int tiles_x, int tiles_y){
+	std::vector<unsigned char> marked(tiles, tiles + tiles_x * tiles_y);
+
+	//The grid is a few hundred entries, a square around each marked one is cheap enough
+	for (int tile_row = 0; tile_row < tiles_y; tile_row++){
+		for (int tile_col = 0; tile_col < tiles_x; tile_col++){
+			if (!marked[tile_row * tiles_x + tile_col]) continue;
+
+			int row_end = std::min(tile_row + radius, tiles_y - 1), col_end = std::min(tile_col + radius, tiles_x - 1);
+			for (int row = std::max(tile_row - radius, 0); row <= row_end; row++)
+				for (int col = std::max(tile_col - radius, 0); col <= col_end; col++) tiles[row * tiles_x + col] = 1;
+		}
+	}
+}
+
+void host_changed_tiles(const unsigned char *prior_im, const unsigned char *input_im, unsigned char *changed, int spread, int tile, int change_threshold, int width, int height, int threads){
+	int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+
+	host_parallel_for(tiles_y, threads, [=](int tile_row_begin, int tile_row_end){
+		std::vector<int> sums(tiles_x);
+
+		for (int tile_row = tile_row_begin; tile_row < tile_row_end; tile_row++){
+			int row_begin = tile_row * tile, row_end = std::min(row_begin + tile, height);
+			std::fill(sums.begin(), sums.end(), 0);
+
+			//Absolute differences 16 pixels at a time, tiles are whole blocks of 16
+			for (int image_row = row_begin; image_row < row_end; image_row++){
+				const unsigned char *prior_row = prior_im + (size_t)image_row * width;
+				const unsigned char *input_row = input_im + (size_t)image_row * width;
+
+				int image_col = 0;
+				for (; image_col + 16 <= width; image_col += 16){
+					__m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(prior_row + image_col)), _mm_loadu_si128((const __m128i*)(input_row + image_col)));
+					sums[image_col / tile] += _mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4);
+				}
+				for (; image_col < width; image_col++) sums[image_col / tile] += abs(prior_row[image_col] - input_row[image_col]);
+			}
+
+			//Mean difference over the threshold marks the tile and the next spread ones to its right
+			for (int tile_col = 0; tile_col < tiles_x; tile_col++){
+				int pixels = (std::min(tile_col * tile + tile, width) - tile_col * tile) * (row_end - row_begin);
+				if (sums[tile_col] <= change_threshold * pixels) continue;
+
+				int last = std::min(tile_col + spread, tiles_x - 1);
+				for (int marked = tile_col; marked <= last; marked++) changed[tile_row * tiles_x + marked] = 1;
+			}
+		}
+	});
+}
+
+void host_search_windows(const unsigned short *coarse_disp, int coarse_width, int coarse_height, int coarse_subpixel_bits, int factor, int radius,
+	unsigned short *window_first, bool fill_missing, int width, int height, int min_disparity, int max_disparity, int threads){
+
+	int size = std::min(2 * radius + 1, max_disparity);
+	int last_first = min_disparity + max_disparity - size;
+
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		for (int image_row = row_begin; image_row < row_end; image_row++){
+			const unsigned short *coarse_row = coarse_disp + (size_t)std::min(image_row / factor, coarse_height - 1) * coarse_width;
+
+			for (int image_col = 0; image_col < width; image_col++){
+				size_t pixel = (size_t)image_row * width + image_col;
+				if (fill_missing && window_first[pixel] != HOST_NO_WINDOW) continue;
+
+				int coarse = coarse_row[std::min(image_col / factor, coarse_width - 1)];
+
+				//Scale to full resolution and round, then centre the window on it within the range
+				int centre = (int)(((long long)coarse * factor + (1 << coarse_subpixel_bits >> 1)) >> coarse_subpixel_bits);
+				window_first[pixel] = (unsigned short)std::min(std::max(centre - radius, min_disparity), last_first);
+			}
+		}
+	});
+}
+
+int host_prior_windows(const unsigned short *prior_disp, const unsigned char *prior_im, const unsigned char *input_im, int change_threshold, int subpixel_bits, int radius,
+	unsigned short *window_first, int width, int height, int min_disparity, int max_disparity, int threads){
+
+	int size = std::min(2 * radius + 1, max_disparity);
+	int last_first = min_disparity + max_disparity - size;
+	std::vector<int> band_missing(height, 0);
+	int *missing = band_missing.data();
+
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		for (int image_row = row_begin; image_row < row_end; image_row++){
+			for (int image_col = 0; image_col < width; image_col++){
+				size_t pixel = (size_t)image_row * width + image_col;
+				int prior = prior_disp[pixel];
+
+				if (prior == OUTLIER || abs(input_im[pixel] - prior_im[pixel]) > change_threshold){
+					window_first[pixel] = HOST_NO_WINDOW;
+					missing[image_row]++;
+					continue;
+				}
+
+				int centre = (prior + (1 << subpixel_bits >> 1)) >> subpixel_bits;
+				window_first[pixel] = (unsigned short)std::min(std::max(centre - radius, min_disparity), last_first);
+			}
+		}
+	});
+
+	int missing_count = 0;
+	for (int image_row = 0; image_row < height; image_row++) missing_count += missing[image_row];
+	return missing_count;
+}
+
+//Windows the rows and both directions when a search window is given
+template <typename T>
+static void apply_window(const host_search_window *window, match_rows &rows, match_direction<T> &left, match_direction<T> &right){
+	if (!window) return;
+
+	rows = rows.windowed(*window);
+	left.window_first = window->left_first;
+	right.window_first = window->right_first;
+}
+
+template <typename D>
+void host_match(const unsigned char *left, const unsigned char *right,
+	const unsigned long long int *left_census, const unsigned long long int *right_census,
+	float *left_agg_vol, float *right_agg_vol, const uchar4 *left_arm_vol, const uchar4 *right_arm_vol,
+	D *left_disp_im, D *right_disp_im, unsigned char *confidence_im, const host_search_window *window, float ad_gamma, float census_gamma, float uniqueness_ratio, int width, int height, int min_disparity, int max_disparity, int threads){
+
+	match_rows rows(left, right, left_census, right_census, width, min_disparity, max_disparity, ad_gamma, census_gamma, uniqueness_ratio);
+	match_direction<float> left_dir = make_direction(left_arm_vol, left_agg_vol, left_disp_im), right_dir = make_direction(right_arm_vol, right_agg_vol, right_disp_im);
+	left_dir.confidence_im = confidence_im;
+	apply_window(window, rows, left_dir, right_dir);
+	match_chunks(rows, left_dir, right_dir, height, [=](const match_rows &chunk_rows, match_direction<float> chunk_left, match_direction<float> chunk_right){
+		match_pair(chunk_rows, chunk_left, chunk_right, height, threads);
+	});
+}
+
+template void host_match<unsigned short>(const unsigned char*, const unsigned char*, const unsigned long long int*, const unsigned long long int*, float*, float*, const uchar4*, const uchar4*, unsigned short*, unsigned short*, unsigned char*, const host_search_window*, float, float, float, int, int, int, int, int);
+template void host_match<unsigned char>(const unsigned char*, const unsigned char*, const unsigned long long int*, const unsigned long long int*, float*, float*, const uchar4*, const uchar4*, unsigned char*, unsigned char*, unsigned char*, const host_search_window*, float, float, float, int, int, int, int, int);
+
+template <typename D>
+void host_match_fixed(const unsigned char *left, const unsigned char *right,
+	const unsigned long long int *left_census, const unsigned long long int *right_census,
+	unsigned int *left_agg_vol, unsigned int *right_agg_vol, const uchar4 *left_arm_vol, const uchar4 *right_arm_vol,
+	D *left_disp_im, D *right_disp_im, unsigned char *confidence_im, const host_search_window *window, float ad_gamma, float census_gamma, float uniqueness_ratio, int width, int height, int min_disparity, int max_disparity, int threads){
+
+	match_rows rows(left, right, left_census, right_census, width, min_disparity, max_disparity, ad_gamma, census_gamma, uniqueness_ratio);
+	match_direction<unsigned int> left_dir = make_direction(left_arm_vol, left_agg_vol, left_disp_im), right_dir = make_direction(right_arm_vol, right_agg_vol, right_disp_im);
+	left_dir.confidence_im = confidence_im;
+	apply_window(window, rows, left_dir, right_dir);
+	match_chunks(rows, left_dir, right_dir, height, [=](const match_rows &chunk_rows, match_direction<unsigned int> chunk_left, match_direction<unsigned int> chunk_right){
+		match_pair(chunk_rows, chunk_left, chunk_right, height, threads);
+	});
+}
+
+template void host_match_fixed<unsigned short>(const unsigned char*, const unsigned char*, const unsigned long long int*, const unsigned long long int*, unsigned int*, unsigned int*, const uchar4*, const uchar4*, unsigned short*, unsigned short*, unsigned char*, const host_search_window*, float, float, float, int, int, int, int, int);
+template void host_match_fixed<unsigned char>(const unsigned char*, const unsigned char*, const unsigned long long int*, const unsigned long long int*, unsigned int*, unsigned int*, const uchar4*, const uchar4*, unsigned char*, unsigned char*, unsigned char*, const host_search_window*, float, float, float, int, int, int, int, int);
+
+size_t host_streaming_volume_size(int width, int height, int max_disparity, int max_arm_length, int threads){
+	int reach = std::max(max_arm_length, 2);
+	int ring_rows = 2 * reach + 2;
+
+	//Bands shorter than their ring would spend more time warming up than producing rows
+	int bands = std::max(1, std::min(threads, height / ring_rows));
+
+	//Per band: a ring of aggregated rows for each direction, one chunk of the range deep
+	return (size_t)bands * 2 * ring_rows * width * host_disparity_chunk(max_disparity);
+}
+
+template <typename D>
+void host_match_streaming(const unsigned char *left, const unsigned char *right,
+	const unsigned long long int *left_census, const unsigned long long int *right_census,
+	float *band_vol, const uchar4 *left_arm_vol, const uchar4 *right_arm_vol, D *left_disp_im, D *right_disp_im, unsigned char *confidence_im, const host_search_window *window,
+	float ad_gamma, float census_gamma, float uniqueness_ratio, int max_arm_length, int width, int height, int min_disparity, int max_disparity, int threads){
+
+	match_rows rows(left, right, left_census, right_census, width, min_disparity, max_disparity, ad_gamma, census_gamma, uniqueness_ratio);
+	match_direction<float> left_dir = make_direction(left_arm_vol, (float*)NULL, left_disp_im), right_dir = make_direction(right_arm_vol, (float*)NULL, right_disp_im);
+	left_dir.confidence_im = confidence_im;
+	apply_window(window, rows, left_dir, right_dir);
+	match_chunks(rows, left_dir, right_dir, height, [=](const match_rows &chunk_rows, match_direction<float> chunk_left, match_direction<float> chunk_right){
+		stream_match(chunk_rows, band_vol, chunk_left, chunk_right, max_arm_length, height, threads);
+	});
+}
+
+template void host_match_streaming<unsigned short>(const unsigned char*, const unsigned char*, const unsigned long long int*, const unsigned long long int*, float*, const uchar4*, const uchar4*, unsigned short*, unsigned short*, unsigned char*, const host_search_window*, float, float, float, int, int, int, int, int, int);
+template void host_match_streaming<unsigned char>(const unsigned char*, const unsigned char*, const unsigned long long int*, const unsigned long long int*, float*, const uchar4*, const uchar4*, unsigned char*, unsigned char*, unsigned char*, const host_search_window*, float, float, float, int, int, int, int, int, int);
+
+template <typename D>
+void host_match_streaming_fixed(const unsigned char *left, const unsigned char *right,
+	const unsigned long long int *left_census, const unsigned long long int *right_census,
+	unsigned int *band_vol, const uchar4 *left_arm_vol, const uchar4 *right_arm_vol, D *left_disp_im, D *right_disp_im, unsigned char *confidence_im, const host_search_window *window,
+	float ad_gamma, float census_gamma, float uniqueness_ratio, int max_arm_length, int width, int height, int min_disparity, int max_disparity, int threads){
+
+	match_rows rows(left, right, left_census, right_census, width, min_disparity, max_disparity, ad_gamma, census_gamma, uniqueness_ratio);
+	match_direction<unsigned int> left_dir = make_direction(left_arm_vol, (unsigned int*)NULL, left_disp_im), right_dir = make_direction(right_arm_vol, (unsigned int*)NULL, right_disp_im);
+	left_dir.confidence_im = confidence_im;
+	apply_window(window, rows, left_dir, right_dir);
+	match_chunks(rows, left_dir, right_dir, height, [=](const match_rows &chunk_rows, match_direction<unsigned int> chunk_left, match_direction<unsigned int> chunk_right){
+		stream_match(chunk_rows, band_vol, chunk_left, chunk_right, max_arm_length, height, threads);
+	});
+}
+
+template void host_match_streaming_fixed<unsigned short>(const unsigned char*, const unsigned char*, const unsigned long long int*, const unsigned long long int*, unsigned int*, const uchar4*, const uchar4*, unsigned short*, unsigned short*, unsigned char*, const host_search_window*, float, float, float, int, int, int, int, int, int);
+template void host_match_streaming_fixed<unsigned char>(const unsigned char*, const unsigned char*, const unsigned long long int*, const unsigned long long int*, unsigned int*, const uchar4*, const uchar4*, unsigned char*, unsigned char*, unsigned char*, const host_search_window*, float, float, float, int, int, int, int, int, int);
+
+template <typename D>
+void host_check_consistency(const D *left_disp_im, const D *right_disp_im, D *output_disp_im, int disparity_tolerance, int subpixel_bits, int width, int height, int threads){
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		for (int image_row = row_begin; image_row < row_end; image_row++){
+			for (int image_col = 0; image_col < width; image_col++){
+				int disp = left_disp_im[image_row * width + image_col];
+				int check_col = image_col - (disp >> subpixel_bits);
+				int to_check = check_col >= 0 ? right_disp_im[image_row * width + check_col] : 0;
+
+				output_disp_im[image_row * width + image_col] = (abs(disp - to_check) <= disparity_tolerance << subpixel_bits) ? disp : OUTLIER;
+			}
+		}
+	});
+}
+
+template void host_check_consistency<unsigned short>(const unsigned short*, const unsigned short*, unsigned short*, int, int, int, int, int);
+template void host_check_consistency<unsigned char>(const unsigned char*, const unsigned char*, unsigned char*, int, int, int, int, int);
+
+template <typename D>
+int host_collect_outliers(const D *disp_im, int *outliers, int width, int height){
+	int outlier_count = 0;
+	for (int pixel = 0; pixel < width * height; pixel++)
+		if (disp_im[pixel] == OUTLIER) outliers[outlier_count++] = pixel;
+
+	return outlier_count;
+}
+
+template int host_collect_outliers<unsigned short>(const unsigned short*, int*, int, int);
+template int host_collect_outliers<unsigned char>(const unsigned char*, int*, int, int);
+
+template <typename D>
+int host_compact_outliers(const D *disp_im, int *outliers, int outlier_count){
+	int remaining = 0;
+	for (int i = 0; i < outlier_count; i++)
+		if (disp_im[outliers[i]] == OUTLIER) outliers[remaining++] = outliers[i];
+
+	return remaining;
+}
+
+template int host_compact_outliers<unsigned short>(const unsigned short*, int*, int);
+template int host_compact_outliers<unsigned char>(const unsigned char*, int*, int);
+
+template <typename D>
+void host_horizontal_voting(D *disp_im, const uchar4 *arm_vol, const int *outliers, int outlier_count, int width, int height, int threads){
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		const int *first = std::lower_bound(outliers, outliers + outlier_count, row_begin * width);
+		const int *last = std::lower_bound(first, outliers + outlier_count, row_end * width);
+		if (first == last) return;
+
+		//Running counts of a row, entry i covers columns [0, i)
+		const int bits = sizeof(D) * 8;
+		std::vector<unsigned short> bit_counts((size_t)(width + 1) * bits, 0), valid_counts(width + 1, 0);
+
+		while (first != last){
+			int image_row = *first / width;
+			const int *row_last = std::lower_bound(first, last, (image_row + 1) * width);
+
+			//Counted before any vote of the row is written, the votes see the row as the previous pass left it
+			D *disp_row = disp_im + image_row * width;
+			for (int image_col = 0; image_col < width; image_col++)
+				count_votes<bits>(&bit_counts[image_col * bits], valid_counts[image_col], disp_row[image_col], &bit_counts[(image_col + 1) * bits], &valid_counts[image_col + 1]);
+
+			for (; first != row_last; first++){
+				int image_col = *first - image_row * width;
+				uchar4 pix_arm = arm_vol[*first];
+
+				//The right arm may reach one past the last column, which votes as an outlier
+				int begin = image_col - pix_arm.z;
+				int end = std::min(image_col + pix_arm.w, width - 1) + 1;
+
+				disp_row[image_col] = (D)window_vote<bits>(&bit_counts[end * bits], &bit_counts[begin * bits], valid_counts[end], valid_counts[begin], pix_arm.z + pix_arm.w + 1);
+			}
+		}
+	});
+}
+
+template void host_horizontal_voting<unsigned short>(unsigned short*, const uchar4*, const int*, int, int, int, int);
+template void host_horizontal_voting<unsigned char>(unsigned char*, const uchar4*, const int*, int, int, int, int);
+
+template <typename D>
+void host_vertical_voting(D *disp_im, const uchar4 *arm_vol, const int *outliers, int outlier_count, int width, int height, int threads){
+
+	//Columns go in tiles so a tile's running counts down the whole image stay in cache, only tiles with outliers are counted
+	int tiles = (width + VOTING_TILE - 1) / VOTING_TILE;
+
+	std::vector<unsigned char> tile_outliers(tiles, 0);
+	for (int i = 0; i < outlier_count; i++) tile_outliers[outliers[i] % width / VOTING_TILE] = 1;
+
+	const unsigned char *tile_flags = tile_outliers.data();
+
+	host_parallel_for(tiles, threads, [=](int tile_begin, int tile_end){
+		//Running counts of the tile's columns, entry [i][col] covers rows [0, i)
+		const int bits = sizeof(D) * 8;
+		std::vector<unsigned short> bit_counts, valid_counts;
+
+		for (int tile = tile_begin; tile < tile_end; tile++){
+			if (!tile_flags[tile]) continue;
+
+			if (bit_counts.empty()){
+				bit_counts.assign((size_t)(height + 1) * VOTING_TILE * bits, 0);
+				valid_counts.assign((size_t)(height + 1) * VOTING_TILE, 0);
+			}
+
+			int col_begin = tile * VOTING_TILE;
+			int cols = std::min(VOTING_TILE, width - col_begin);
+
+			for (int image_row = 0; image_row < height; image_row++){
+				const D *disp_row = disp_im + image_row * width + col_begin;
+				size_t entry = (size_t)image_row * VOTING_TILE;
+
+				for (int col = 0; col < cols; col++){
+					count_votes<bits>(&bit_counts[(entry + col) * bits], valid_counts[entry + col], disp_row[col],
+						&bit_counts[(entry + VOTING_TILE + col) * bits], &valid_counts[entry + VOTING_TILE + col]);
+				}
+			}
+
+			//Votes on the full value of the map; vertical_voting_kernel fetches the texels as unsigned char
+			for (int image_row = 0; image_row < height; image_row++){
+				for (int col = 0; col < cols; col++){
+					int image_col = col_begin + col;
+					if (disp_im[image_row * width + image_col] != OUTLIER) continue;
+
+					uchar4 pix_arm = arm_vol[image_row * width + image_col];
+
+					size_t begin = (size_t)(image_row - pix_arm.x) * VOTING_TILE + col;
+					size_t end = (size_t)(image_row + pix_arm.y + 1) * VOTING_TILE + col;
+
+					disp_im[image_row * width + image_col] = (D)window_vote<bits>(&bit_counts[end * bits], &bit_counts[begin * bits], valid_counts[end], valid_counts[begin],
+						pix_arm.x + pix_arm.y + 1);
+				}
+			}
+		}
+	});
+}
+
+template void host_vertical_voting<unsigned short>(unsigned short*, const uchar4*, const int*, int, int, int, int);
+template void host_vertical_voting<unsigned char>(unsigned char*, const uchar4*, const int*, int, int, int, int);
+
+template <typename D>
+void host_fill_holes(D *disp_im, int width, int height, int threads){
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		std::vector<int> left_valid(width);
+
+		for (int image_row = row_begin; image_row < row_end; image_row++){
+			D *disp_row = disp_im + image_row * width;
+
+			//Forward sweep: nearest valid column to the left of each pixel, -1 when there is none
+			int last_valid = -1;
+			for (int image_col = 0; image_col < width; image_col++){
+				left_valid[image_col] = last_valid;
+				if (disp_row[image_col] != OUTLIER) last_valid = image_col;
+			}
+
+			//Backward sweep: nearest valid column to the right, tracked on the values before this row was filled
+			int next_valid = width;
+			for (int image_col = width - 1; image_col >= 0; image_col--){
+				if (disp_row[image_col] != OUTLIER){
+					next_valid = image_col;
+					continue;
+				}
+
+				int left_col = left_valid[image_col];
+				int left_disp = left_col >= 0 ? disp_row[left_col] : OUTLIER;
+				int right_disp = next_valid < width ? disp_row[next_valid] : OUTLIER;
+
+				//Same rules as extrapolation_kernel: a neighbour sitting on the image edge defers to the other side, and the
+				//gap (both scans count the pixel itself) only limits holes enclosed away from the edges
+				bool is_left_edge = left_col == 0, is_right_edge = next_valid == width - 1;
+				int gap = next_valid - left_col;
+
+				int val = std::min(is_left_edge ? right_disp : left_disp, is_right_edge ? left_disp : right_disp);
+				disp_row[image_col] = (D)(gap <= FILL_MAX_GAP || is_left_edge || is_right_edge ? val : OUTLIER);
+			}
+		}
+	});
+}
+
+template void host_fill_holes<unsigned short>(unsigned short*, int, int, int);
+template void host_fill_holes<unsigned char>(unsigned char*, int, int, int);
+
+template <typename D>
+void host_median_filter(const D *input_disp, D *output_disp, int width, int height, int threads){
+	host_parallel_for(height, threads, [=](int row_begin, int row_end){
+		//Zero rows above and below the frame, zero columns either side come from the padding of the column arrays
+		std::vector<D> zeros(width, 0);
+		std::vector<D> lo(width + 2, 0), mid(width + 2, 0), hi(width + 2, 0);
+
+		D bias = (D)(sizeof(D) == 2 && !has_avx2 ? 0x8000 : 0);
+		lo[0] = mid[0] = hi[0] = lo[width + 1] = mid[width + 1] = hi[width + 1] = bias;
+
+		for (int y = row_begin; y < row_end; y++){
+			const D *above = y > 0 ? input_disp + (y - 1) * width : zeros.data();
+			const D *below = y < height - 1 ? input_disp + (y + 1) * width : zeros.data();
+
+			if (has_avx2)
+				median_row_avx2(above, input_disp + y * width, below, lo.data(), mid.data(), hi.data(), output_disp + y * width, width);
+			else
+				median_row_sse2(above, input_disp + y * width, below, lo.data(), mid.data(), hi.data(), output_disp + y * width, width);
+		}
+	});
+}
+
+template void host_median_filter<unsigned short>(const unsigned short*, unsigned short*, int, int, int);
+template void host_median_filter<unsigned char>(const unsigned char*, unsigned char*, int, int, int);
+
+template <typename D>
+int host_disparity_histogram(const D *disp_im, int *histogram, int bins, int subpixel_bits, int width, int height){
+	std::fill(histogram, histogram + bins, 0);
+
+	int valid_count = 0;
+	for (int pixel = 0; pixel < width * height; pixel++){
+		if (disp_im[pixel] == OUTLIER) continue;
+
+		int disparity = (disp_im[pixel] + (1 << subpixel_bits >> 1)) >> subpixel_bits;
+		histogram[std::min(disparity, bins - 1)]++;
+		valid_count++;
+	}
+
+	return valid_count;
+}
+
+template int host_disparity_histogram<unsigned short>(const unsigned short*, int*, int, int, int, int);
+template int host_disparity_histogram<unsigned char>(const unsigned char*, int*, int, int, int, int);
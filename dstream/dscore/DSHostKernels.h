@@ -0,0 +1,192 @@
+#pragma once
+#include <thread>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#define OUTLIER 0
+
+//Most candidates the host matcher aggregates at once, wider ranges are matched in chunks of at most this many
+#define HOST_DISPARITY_CHUNK 256
+
+//First candidate of a pixel whose search window is still to be chosen
+#define HOST_NO_WINDOW 0xFFFF
+
+//Splits [0, count) into contiguous bands and runs body(begin, end) for each band on its own thread
+template <typename F>
+void host_parallel_for(int count, int threads, F body){
+	if (threads <= 1 || count <= 1){
+		body(0, count);
+		return;
+	}
+
+	if (threads > count) threads = count;
+
+	int band = (count + threads - 1) / threads;
+
+	std::vector<std::thread> workers;
+	for (int begin = band; begin < count; begin += band){
+		int end = begin + band < count ? begin + band : count;
+		workers.push_back(std::thread(body, begin, end));
+	}
+
+	body(0, band);
+
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+//Runs first(threads) and second(threads) side by side on two disjoint groups splitting the given thread count
+template <typename F, typename G>
+void host_parallel_pair(int threads, F first, G second){
+	if (threads <= 1){
+		first(1);
+		second(1);
+		return;
+	}
+
+	int first_threads = threads / 2;
+
+	std::thread worker(first, first_threads);
+	second(threads - first_threads);
+	worker.join();
+}
+
+int host_default_threads();
+
+//Fractional bits of the disparity maps: 8 while min_disparity + max_disparity fits 8.8, fewer for wider ranges
+int host_subpixel_bits(int min_disparity, int max_disparity);
+
+//Candidates per chunk for a range of max_disparity, the depth the cost volumes need
+int host_disparity_chunk(int max_disparity);
+
+void host_census_transform(const unsigned char *input_im, unsigned long long int *output_census, int width, int height, int threads);
+
+//Arms of a whole row at a time: left and right arms scan along the row, up and down arms across the rows above and below,
+//every step covering a vector of neighbouring pixels. Bit-exact with cross_construct_kernel
+void host_cross_construct(const unsigned char *input_im, uchar4 *arm_vol, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int width, int height, int threads);
+
+//Arms from an interleaved BGR image, bit-exact with cross_construct_kernel_bgr: a pixel joins the arm while the largest
+//channel difference to the anchor and to the next pixel along the arm both stay within the threshold
+void host_cross_construct_bgr(const unsigned char *input_bgr, uchar4 *arm_vol, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int width, int height, int threads);
+
+//Box average of each factor x factor block, the output is (width / factor) x (height / factor)
+void host_downsample(const unsigned char *input_im, unsigned char *output_im, int width, int height, int factor, int threads);
+
+//Marks the tile x tile blocks (tile a multiple of 16) whose mean absolute difference between prior_im and input_im
+//exceeds change_threshold, along with the spread blocks to the right of each. changed holds one entry per block, row
+//by row, and marked entries are set to 1 without clearing the others
+void host_changed_tiles(const unsigned char *prior_im, const unsigned char *input_im, unsigned char *changed, int spread, int tile, int change_threshold, int width, int height, int threads);
+
+//Marks every block within radius blocks, in either direction, of a marked one in a tiles_x x tiles_y grid
+void host_dilate_tiles(unsigned char *tiles, int radius, int tiles_x, int tiles_y);
+
+//Marks the tile x tile blocks holding a nonzero mask pixel, in the layout of host_changed_tiles
+void host_mask_tiles(const unsigned char *mask, unsigned char *tiles, int tile, int width, int height, int threads);
+
+//Per-pixel search windows for coarse-to-fine matching: the candidates of a pixel are size = 2 * radius + 1 (at most
+//max_disparity) disparities from window_first[pixel], which centres them on the disparity of the coarse pixel it falls
+//in, scaled by factor, and keeps them within [min_disparity, min_disparity + max_disparity). With fill_missing only the
+//pixels at HOST_NO_WINDOW are written
+void host_search_windows(const unsigned short *coarse_disp, int coarse_width, int coarse_height, int coarse_subpixel_bits, int factor, int radius,
+	unsigned short *window_first, bool fill_missing, int width, int height, int min_disparity, int max_disparity, int threads);
+
+//Search windows of the same shape centred on the previous frame's disparities (prior_disp, with subpixel_bits
+//fractional bits). Pixels whose prior is an outlier or whose intensity moved by more than change_threshold since
+//prior_im are set to HOST_NO_WINDOW instead; returns how many
+int host_prior_windows(const unsigned short *prior_disp, const unsigned char *prior_im, const unsigned char *input_im, int change_threshold, int subpixel_bits, int radius,
+	unsigned short *window_first, int width, int height, int min_disparity, int max_disparity, int threads);
+
+//Per-pixel candidates of the matching stage in place of the shared range, size of them from each pixel's first entry
+//(see host_search_windows). size is at most HOST_DISPARITY_CHUNK; right_first may be NULL when only the left is matched
+struct host_search_window{
+	const unsigned short *left_first, *right_first;
+	int size;
+};
+
+//Both matching directions at once, each with its own cross (left_arm_vol matches left to right) and volume of
+//horizontal aggregates, over which vertical aggregation, winner-take-all and subpixel refinement run as one fused pass.
+//Without AVX2 the AD + census cost is evaluated once per row in the left reference and the right reference reads it
+//through the sheared index C_R(x, d) = C_L(x + d, d); the vector cost engines recompute it faster than it can be sheared
+//The max_disparity candidates start at min_disparity and the maps hold absolute disparities with host_subpixel_bits
+//fractional bits. Ranges wider than HOST_DISPARITY_CHUNK are matched chunk by chunk, each pixel's running winner
+//carried across chunks, so the volumes hold width * height * host_disparity_chunk(max_disparity) elements.
+//Maps of unsigned char (D) get integer disparities instead, without subpixel refinement; the range has to end by 256.
+//The disparity stages below take either kind of map
+//Winners whose aggregated cost exceeds uniqueness_ratio times the best cost outside the winner and its two neighbours
+//are marked OUTLIER as they are picked; a ratio of 1 or more keeps them all. A NULL right_disp_im matches the left
+//reference only, right_agg_vol and right_arm_vol are then not touched
+//confidence_im, when not NULL, gets an 8-bit confidence for each left winner from the same sweep: the harmonic mean of
+//its margin to the second best (1 - best / second) and the curvature of the costs around it, scaled to [0, 255].
+//Pixels the uniqueness test rejects get 0
+//A non-NULL window restricts every pixel to its own window of candidates (still within the range, which keeps setting
+//the subpixel bits) and the volumes to width * height * window->size. Aggregation then runs over the offset into each
+//window: on a surface the coarse estimate follows, neighbouring costs line up at the same residual offset
+template <typename D>
+void host_match(const unsigned char *left, const unsigned char *right,
+	const unsigned long long int *left_census, const unsigned long long int *right_census,
+	float *left_agg_vol, float *right_agg_vol, const uchar4 *left_arm_vol, const uchar4 *right_arm_vol,
+	D *left_disp_im, D *right_disp_im, unsigned char *confidence_im, const host_search_window *window, float ad_gamma, float census_gamma, float uniqueness_ratio, int width, int height, int min_disparity, int max_disparity, int threads);
+
+//Fixed-point variant of host_match. The cost is the float cost scaled by 255 * 64 = 16320 with rounded integer weights
+//(ad_gamma * 64, census_gamma * 255, gammas clamped to [0, 1]), evaluated as uint16 and aggregated exactly in 32 bits.
+//Only the weight rounding deviates from the float pipeline: per pixel the cost differs by at most
+//(0.5 * 255 + 0.5 * 64) / 16320 < 0.01 float units, so over a support region of N pixels the winner can only change
+//where the float best and second best aggregated costs are closer than 0.02 * N, and the subpixel offset stays within
+//+-0.5 of the integer winner as in the float path. The uint16 costs only live in per-row scratch, the aggregate
+//volumes hold uint32 sums and take as many bytes as the float ones
+template <typename D>
+void host_match_fixed(const unsigned char *left, const unsigned char *right,
+	const unsigned long long int *left_census, const unsigned long long int *right_census,
+	unsigned int *left_agg_vol, unsigned int *right_agg_vol, const uchar4 *left_arm_vol, const uchar4 *right_arm_vol,
+	D *left_disp_im, D *right_disp_im, unsigned char *confidence_im, const host_search_window *window, float ad_gamma, float census_gamma, float uniqueness_ratio, int width, int height, int min_disparity, int max_disparity, int threads);
+
+//Elements of scratch host_match_streaming(_fixed) needs for a given max_arm_length and thread count
+size_t host_streaming_volume_size(int width, int height, int max_disparity, int max_arm_length, int threads);
+
+//Same result as host_match without full volumes: each thread slides a ring of 2 * max_arm_length + 2 aggregated rows
+//per direction down its band of output rows. The running sums restart per band, so costs agree with host_match up to
+//float rounding
+template <typename D>
+void host_match_streaming(const unsigned char *left, const unsigned char *right,
+	const unsigned long long int *left_census, const unsigned long long int *right_census,
+	float *band_vol, const uchar4 *left_arm_vol, const uchar4 *right_arm_vol, D *left_disp_im, D *right_disp_im, unsigned char *confidence_im, const host_search_window *window,
+	float ad_gamma, float census_gamma, float uniqueness_ratio, int max_arm_length, int width, int height, int min_disparity, int max_disparity, int threads);
+
+//Streaming host_match_fixed. Integer sums make it bit-exact with host_match_fixed
+template <typename D>
+void host_match_streaming_fixed(const unsigned char *left, const unsigned char *right,
+	const unsigned long long int *left_census, const unsigned long long int *right_census,
+	unsigned int *band_vol, const uchar4 *left_arm_vol, const uchar4 *right_arm_vol, D *left_disp_im, D *right_disp_im, unsigned char *confidence_im, const host_search_window *window,
+	float ad_gamma, float census_gamma, float uniqueness_ratio, int max_arm_length, int width, int height, int min_disparity, int max_disparity, int threads);
+
+template <typename D>
+void host_check_consistency(const D *left_disp_im, const D *right_disp_im, D *output_disp_im, int disparity_tolerance, int subpixel_bits, int width, int height, int threads);
+
+//Writes the ascending indices of the OUTLIER pixels to outliers and returns how many there are
+template <typename D>
+int host_collect_outliers(const D *disp_im, int *outliers, int width, int height);
+
+//Drops the pixels a voting pass resolved from the outlier list, returns how many remain
+template <typename D>
+int host_compact_outliers(const D *disp_im, int *outliers, int outlier_count);
+
+//Region voting passes over the listed outliers only, in place. Each vote counts the disparities as the previous pass
+//left them, like the texture snapshot on the device, so a pass gives the same map as a full out-of-place sweep
+template <typename D>
+void host_horizontal_voting(D *disp_im, const uchar4 *arm_vol, const int *outliers, int outlier_count, int width, int height, int threads);
+
+template <typename D>
+void host_vertical_voting(D *disp_im, const uchar4 *arm_vol, const int *outliers, int outlier_count, int width, int height, int threads);
+
+//Fills each row's outliers in place from the smaller of the nearest valid disparities on either side, with the gap
+//limit and edge rules of extrapolation_kernel, in one forward and one backward sweep per row
+template <typename D>
+void host_fill_holes(D *disp_im, int width, int height, int threads);
+
+template <typename D>
+void host_median_filter(const D *input_disp, D *output_disp, int width, int height, int threads);
+
+//Counts the valid pixels of a map by rounded integer disparity, larger ones in the last of the bins; returns how many
+//were counted
+template <typename D>
+int host_disparity_histogram(const D *disp_im, int *histogram, int bins, int subpixel_bits, int width, int height);
@@ -5,23 +5,78 @@
 #include <arrayfire.h>
 #endif
 
-DSMatcher::DSMatcher(){}
+DSMatcher::DSMatcher(){
+	backend = DSCore::CUDA_BACKEND;
+	options = DSCore::DEFAULT_OPTIONS;
+}
 
-DSMatcher::DSMatcher(int width, int height, int disparities)
+DSMatcher::DSMatcher(int width, int height, int disparities, DSCore::core_backend backend, int threads, int options)
 {
 	//Setup parameters
 	this->width = width;
 	this->height = height;
+	this->min_disparity = 0;
 	this->disparities = disparities;
+	this->backend = backend;
+	this->options = backend == DSCore::HOST_BACKEND ? options : DSCore::DEFAULT_OPTIONS; //Options only apply to the host backend
+
+	//Initalize core
+	core.setup(this->width, this->height, this->disparities, backend, threads, options);
+}
+
+DSMatcher::DSMatcher(int width, int height, int min_disparity, int num_disparities, DSCore::core_backend backend, int threads, int options)
+{
+	//Setup parameters
+	this->width = width;
+	this->height = height;
+	this->min_disparity = min_disparity;
+	this->disparities = num_disparities;
+	this->backend = backend;
+	this->options = backend == DSCore::HOST_BACKEND ? options : DSCore::DEFAULT_OPTIONS; //Options only apply to the host backend
 
 	//Initalize core
-	core.setup(this->width, this->height, this->disparities);
+	core.setup(this->width, this->height, this->min_disparity, this->disparities, backend, threads, options);
 }
 
 DSMatcher::~DSMatcher(){
 
 }
 
+int DSMatcher::get_subpixel_bits(){
+	return core.get_subpixel_bits();
+}
+
+void DSMatcher::set_uniqueness_ratio(float ratio){
+	core.set_uniqueness_ratio(ratio);
+}
+
+void DSMatcher::set_pyramid(int factor, int radius){
+	core.set_pyramid(factor, radius);
+}
+
+void DSMatcher::set_temporal(int radius, int change_threshold, int refresh_interval){
+	core.set_temporal(radius, change_threshold, refresh_interval);
+}
+
+void DSMatcher::set_adaptive_range(int margin, int refresh_interval){
+	core.set_adaptive_range(margin, refresh_interval);
+}
+
+void DSMatcher::set_change_detection(int tile, int change_threshold){
+	core.set_change_detection(tile, change_threshold);
+}
+
+bool DSMatcher::get_confidence(cv::Mat &confidence_im){
+	if (confidence.empty()) return false;
+
+	confidence_im = confidence.clone();
+	return true;
+}
+
+int DSMatcher::get_outlier_count(){
+	return core.get_outlier_count();
+}
+
 bool DSMatcher::compute(DSFrame frame, cv::Mat &disp_im, int gamma, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int region_voting_iterations, int disparity_tolerance){
 #ifdef TIME
 	af::timer::start();
@@ -36,6 +91,16 @@ bool DSMatcher::compute(DSFrame frame, cv::Mat &disp_im, int gamma, int arm_leng
 	cv::Mat left_frame, right_frame;
 	frame.get_frames(left_frame, right_frame);
 
+	//Colour crosses need the frames before they are converted to gray
+	if (options & DSCore::COLOR_ARMS){
+		cv::Mat left_color = left_frame, right_color = right_frame;
+		if (left_color.channels() == 1) cv::cvtColor(left_color, left_color, CV_GRAY2BGR);
+		if (right_color.channels() == 1) cv::cvtColor(right_color, right_color, CV_GRAY2BGR);
+
+		core.copy_from_host_to_device(left_color.data, DSCore::core_data::LEFT_COLOR_DATA);
+		core.copy_from_host_to_device(right_color.data, DSCore::core_data::RIGHT_COLOR_DATA);
+	}
+
 	if (left_frame.channels() == 3) cv::cvtColor(left_frame, left_frame, CV_BGR2GRAY);
 	if (right_frame.channels() == 3) cv::cvtColor(right_frame, right_frame, CV_BGR2GRAY);
 
@@ -46,63 +111,160 @@ bool DSMatcher::compute(DSFrame frame, cv::Mat &disp_im, int gamma, int arm_leng
 	//Compute
 	core.stereo_match(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations);
 
-	//Transfer result to host
-	cv::Mat disparity_temp = cv::Mat::zeros(frame.get_height(), frame.get_width(), CV_16UC1);
+	//Transfer result to host, 8-bit for integer maps
+	cv::Mat disparity_temp = cv::Mat::zeros(frame.get_height(), frame.get_width(), core.get_disparity_size() == 1 ? CV_8UC1 : CV_16UC1);
 	core.copy_from_device_to_host(disparity_temp.data, DSCore::core_data::FINAL_DISP_DATA);
 
 	disp_im = disparity_temp.clone();
 
+	if (options & DSCore::CONFIDENCE_MAP){
+		confidence = cv::Mat::zeros(frame.get_height(), frame.get_width(), CV_8UC1);
+		core.copy_from_device_to_host(confidence.data, DSCore::core_data::CONFIDENCE_DATA);
+	}
+
 #ifdef TIME
 	printf("elapsed seconds: %g\n", af::timer::stop());
 #endif
 	return true;
 }
 
-bool DSMatcher::compute(DSFrame frame, cv::Rect roi, cv::Mat &disp_im, int gamma, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int region_voting_iterations, int disparity_tolerance){
+bool DSMatcher::compute(DSFrame frame, const cv::Mat &mask, cv::Mat &disp_im, int gamma, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int region_voting_iterations, int disparity_tolerance){
 #ifdef TIME
 	af::timer::start();
 #endif
 
-	int w = roi.width;
-	int h = roi.height;
-
-	if (w > width) throw new DSException(stereo_exceptions::SIZE_ERROR);
-	if (h > height) throw new DSException(stereo_exceptions::SIZE_ERROR);
-
 	float ad_gamma = gamma / 100.0f;
 	float census_gamma = 1.0f - (ad_gamma);
 
 	if (!(frame.get_width() == width && frame.get_height() == height)) throw DSException(stereo_exceptions::SIZE_ERROR);
+	if (!(mask.cols == width && mask.rows == height && mask.type() == CV_8UC1)) throw DSException(stereo_exceptions::SIZE_ERROR);
+
+	//The device kernels run on whole frames, they match the bounding box of the mask as an ROI instead, grown by the
+	//aggregation and voting support of its border pixels. The ROI match adds the range on either side
+	if (backend != DSCore::HOST_BACKEND){
+		cv::Rect roi = cv::boundingRect(mask);
+		if (roi.area() > 0){
+			roi.x -= 2 * max_arm_length;
+			roi.y -= 2 * max_arm_length;
+			roi.width += 4 * max_arm_length;
+			roi.height += 4 * max_arm_length;
+			roi &= cv::Rect(0, 0, width, height);
+		}
+
+		compute(frame, roi, disp_im, gamma, arm_length, max_arm_length, arm_threshold, strict_arm_threshold, region_voting_iterations, disparity_tolerance);
+		disp_im.setTo(0, mask == 0);
+		return true;
+	}
 
 	cv::Mat left_frame, right_frame;
 	frame.get_frames(left_frame, right_frame);
 
+	//Colour crosses need the frames before they are converted to gray
+	if (options & DSCore::COLOR_ARMS){
+		cv::Mat left_color = left_frame, right_color = right_frame;
+		if (left_color.channels() == 1) cv::cvtColor(left_color, left_color, CV_GRAY2BGR);
+		if (right_color.channels() == 1) cv::cvtColor(right_color, right_color, CV_GRAY2BGR);
+
+		core.copy_from_host_to_device(left_color.data, DSCore::core_data::LEFT_COLOR_DATA);
+		core.copy_from_host_to_device(right_color.data, DSCore::core_data::RIGHT_COLOR_DATA);
+	}
+
 	if (left_frame.channels() == 3) cv::cvtColor(left_frame, left_frame, CV_BGR2GRAY);
 	if (right_frame.channels() == 3) cv::cvtColor(right_frame, right_frame, CV_BGR2GRAY);
 
-	cv::Mat left_temp = cv::Mat::zeros(frame.get_height(), frame.get_width(), CV_8UC1);
-	cv::Mat right_temp = cv::Mat::zeros(frame.get_height(), frame.get_width(), CV_8UC1);
+	//Transfer images to device
+	core.copy_from_host_to_device(left_frame.data, DSCore::core_data::LEFT_DATA);
+	core.copy_from_host_to_device(right_frame.data, DSCore::core_data::RIGHT_DATA);
+
+	//Compute around the masked pixels
+	cv::Mat mask_data = mask.isContinuous() ? mask : mask.clone();
+	core.stereo_match(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, mask_data.data);
+
+	//Transfer result to host, 8-bit for integer maps
+	cv::Mat disparity_temp = cv::Mat::zeros(frame.get_height(), frame.get_width(), core.get_disparity_size() == 1 ? CV_8UC1 : CV_16UC1);
+	core.copy_from_device_to_host(disparity_temp.data, DSCore::core_data::FINAL_DISP_DATA);
+
+	disp_im = disparity_temp;
+
+	if (options & DSCore::CONFIDENCE_MAP){
+		confidence = cv::Mat::zeros(frame.get_height(), frame.get_width(), CV_8UC1);
+		core.copy_from_device_to_host(confidence.data, DSCore::core_data::CONFIDENCE_DATA);
+	}
+
+#ifdef TIME
+	printf("elapsed seconds: %g\n", af::timer::stop());
+#endif
+	return true;
+}
+
+bool DSMatcher::compute(DSFrame frame, cv::Rect roi, cv::Mat &disp_im, int gamma, int arm_length, int max_arm_length, int arm_threshold, int strict_arm_threshold, int region_voting_iterations, int disparity_tolerance){
+#ifdef TIME
+	af::timer::start();
+#endif
+
+	if (roi.width > width) throw new DSException(stereo_exceptions::SIZE_ERROR);
+	if (roi.height > height) throw new DSException(stereo_exceptions::SIZE_ERROR);
 
-	left_frame(roi).copyTo(left_temp(cv::Rect(0, 0, roi.width, roi.height)));
-	right_frame(roi).copyTo(right_temp(cv::Rect(0, 0, roi.width, roi.height)));
+	float ad_gamma = gamma / 100.0f;
+	float census_gamma = 1.0f - (ad_gamma);
+
+	if (!(frame.get_width() == width && frame.get_height() == height)) throw DSException(stereo_exceptions::SIZE_ERROR);
+
+	//The ROI pixels match into the range to their left, and the right winners their consistency check reads search the
+	//range to their right, so the frames are matched from that far on either side of it
+	roi &= cv::Rect(0, 0, width, height);
+	if (roi.area() == 0){
+		disp_im = cv::Mat::zeros(height, width, core.get_disparity_size() == 1 ? CV_8UC1 : CV_16UC1);
+		return true;
+	}
+
+	int match_x = std::max(roi.x - (min_disparity + disparities), 0);
+	int match_end = std::min(roi.x + roi.width + min_disparity + disparities, width);
+	cv::Rect match_roi(match_x, roi.y, match_end - match_x, roi.height);
+	int w = match_roi.width;
+	int h = match_roi.height;
+
+	cv::Mat left_frame, right_frame;
+	frame.get_frames(left_frame, right_frame);
 
-	left_frame = left_temp;
-	right_frame = right_temp;
+	//Only the matched block goes to the core, stored contiguously
+	if (options & DSCore::COLOR_ARMS){
+		cv::Mat left_color = left_frame(match_roi).clone(), right_color = right_frame(match_roi).clone();
+		if (left_color.channels() == 1) cv::cvtColor(left_color, left_color, CV_GRAY2BGR);
+		if (right_color.channels() == 1) cv::cvtColor(right_color, right_color, CV_GRAY2BGR);
+
+		core.copy_from_host_to_device(left_color.data, DSCore::core_data::LEFT_COLOR_DATA, w, h);
+		core.copy_from_host_to_device(right_color.data, DSCore::core_data::RIGHT_COLOR_DATA, w, h);
+	}
+
+	left_frame = left_frame(match_roi).clone();
+	right_frame = right_frame(match_roi).clone();
+
+	if (left_frame.channels() == 3) cv::cvtColor(left_frame, left_frame, CV_BGR2GRAY);
+	if (right_frame.channels() == 3) cv::cvtColor(right_frame, right_frame, CV_BGR2GRAY);
 
 	//Transfer images to device
-	core.copy_from_host_to_device(left_frame.data, DSCore::core_data::LEFT_DATA);
-	core.copy_from_host_to_device(right_frame.data, DSCore::core_data::RIGHT_DATA);
+	core.copy_from_host_to_device(left_frame.data, DSCore::core_data::LEFT_DATA, w, h);
+	core.copy_from_host_to_device(right_frame.data, DSCore::core_data::RIGHT_DATA, w, h);
 
 	//Compute
 	core.stereo_match(arm_length, max_arm_length, arm_threshold, strict_arm_threshold, ad_gamma, census_gamma, disparity_tolerance, region_voting_iterations, w, h);
 
-	//Transfer result to host
-	cv::Mat disparity_temp = cv::Mat::zeros(frame.get_height(), frame.get_width(), CV_16UC1);
-	core.copy_from_device_to_host(disparity_temp.data, DSCore::core_data::FINAL_DISP_DATA);
+	//Transfer the block to host, 8-bit for integer maps, and place the ROI part in a frame-sized map
+	cv::Mat disparity_temp(h, w, core.get_disparity_size() == 1 ? CV_8UC1 : CV_16UC1);
+	core.copy_from_device_to_host(disparity_temp.data, DSCore::core_data::FINAL_DISP_DATA, w, h);
+
+	cv::Rect block_roi(roi.x - match_x, 0, roi.width, roi.height);
+	disp_im = cv::Mat::zeros(frame.get_height(), frame.get_width(), disparity_temp.type());
+	disparity_temp(block_roi).copyTo(disp_im(roi));
 
-	disp_im = cv::Mat::zeros(frame.get_height(), frame.get_width(), CV_16UC1);
+	if (options & DSCore::CONFIDENCE_MAP){
+		cv::Mat confidence_temp(h, w, CV_8UC1);
+		core.copy_from_device_to_host(confidence_temp.data, DSCore::core_data::CONFIDENCE_DATA, w, h);
 
-	disparity_temp(cv::Rect(0, 0, roi.width, roi.height)).copyTo(disp_im(roi));
+		confidence = cv::Mat::zeros(frame.get_height(), frame.get_width(), CV_8UC1);
+		confidence_temp(block_roi).copyTo(confidence(roi));
+	}
 
 #ifdef TIME
 	printf("elapsed seconds: %g\n", af::timer::stop());
@@ -15,17 +15,56 @@ private:
 	DSCore core;
 
 	//Stereo parameters
-	int width, height, disparities;
+	int width, height, min_disparity, disparities;
+	DSCore::core_backend backend;
+	int options;
+
+	//Confidence of the last computed frame, laid out like its disparity map
+	cv::Mat confidence;
 
 public:
 	DSMatcher();
-	DSMatcher::DSMatcher(int width, int height, int disparities);
+	DSMatcher::DSMatcher(int width, int height, int disparities, DSCore::core_backend backend = DSCore::CUDA_BACKEND, int threads = 0, int options = DSCore::DEFAULT_OPTIONS);
+	//Matches exactly num_disparities candidates starting at min_disparity, output disparities stay absolute
+	DSMatcher::DSMatcher(int width, int height, int min_disparity, int num_disparities, DSCore::core_backend backend = DSCore::CUDA_BACKEND, int threads = 0, int options = DSCore::DEFAULT_OPTIONS);
 	~DSMatcher();
 
 	//Class methods
 	bool compute(DSFrame frame, cv::Mat &disp_im, int gamma = 30, int arm_length = 8, int max_arm_length = 17, 
 		int arm_threshold = 15, int strict_arm_threshold = 6, int region_voting_iterations = 4, int disparity_tolerance = 1);
+	//Matches only roi, extended left by the disparity range it matches into; disp_im is frame-sized with zeros outside roi
 	bool compute(DSFrame frame, cv::Rect roi, cv::Mat &disp_im, int gamma = 30, int arm_length = 8, int max_arm_length = 17,
 		int arm_threshold = 15, int strict_arm_threshold = 6, int region_voting_iterations = 4, int disparity_tolerance = 1);
+
+	//Disparities only where the CV_8UC1 frame-sized mask is nonzero, zero elsewhere. The host backend matches only the
+	//regions around the masked pixels, see DSCore::stereo_match; the CUDA backend matches the padded bounding box of the
+	//mask as an ROI
+	bool compute(DSFrame frame, const cv::Mat &mask, cv::Mat &disp_im, int gamma = 30, int arm_length = 8, int max_arm_length = 17,
+		int arm_threshold = 15, int strict_arm_threshold = 6, int region_voting_iterations = 4, int disparity_tolerance = 1);
+
+	//Fractional bits of the computed disparities, 8 unless the range ends past 256
+	int get_subpixel_bits();
+
+	//Rejects winners whose aggregated cost exceeds ratio times the best cost outside their neighbours, see DSCore
+	void set_uniqueness_ratio(float ratio);
+
+	//Coarse level factor and full-resolution window radius of DSCore::PYRAMID_MATCHING
+	void set_pyramid(int factor, int radius);
+
+	//Window radius, change threshold and full range refresh interval of DSCore::TEMPORAL_PRIOR, also starts a new sequence
+	void set_temporal(int radius, int change_threshold, int refresh_interval);
+
+	//Margin and full range refresh interval of DSCore::ADAPTIVE_RANGE, also restarts from the whole range
+	void set_adaptive_range(int margin, int refresh_interval);
+
+	//Tile size and change threshold of DSCore::CHANGE_DETECTION, also drops the reference frames
+	void set_change_detection(int tile, int change_threshold);
+
+	//CV_8UC1 confidence of the last computed frame (255 most confident), false unless the host backend was set up with
+	//DSCore::CONFIDENCE_MAP
+	bool get_confidence(cv::Mat &confidence_im);
+
+	//Outliers region voting left unresolved in the last computed frame, -1 on the CUDA backend
+	int get_outlier_count();
 };
 
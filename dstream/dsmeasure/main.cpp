@@ -41,22 +41,6 @@ void create_depthmap(cv::Mat disparity, cv::Mat q, cv::Mat &depthmap, float divi
 	cv::reprojectImageTo3D(depthmap, depthmap, q);
 }
 
-void create_rectangle(cv::Mat mask, cv::Rect &rectangle, int allowance){
-	rectangle = cv::boundingRect(mask);
-
-	rectangle.x = 0;
-	rectangle.width = mask.cols;
-
-	rectangle.y = (rectangle.y - allowance < 0) ? 0 : rectangle.y - allowance;
-	
-	int y_max = rectangle.y + rectangle.height + 2 * allowance;
-
-	if (y_max > mask.rows)
-		y_max = mask.rows;
-
-	rectangle.height = abs(y_max - rectangle.y);
-}
-
 void on_trackbar(int, void*){
 	cv::FileStorage fs = cv::FileStorage("config.yml", cv::FileStorage::WRITE);
 
@@ -144,12 +128,8 @@ int main(){
 			cv::cvtColor(left, hsv, CV_BGR2HSV);
 			create_mask(hsv, mask, hue_min, hue_max, sat_min, sat_max, val_min, val_max, morph_size);
 
-			//Find the bounding rectangle
-			create_rectangle(mask, rectangle, 20);
-
-			//Compute the disparity
-			matcher.compute(DSFrame(left, right), rectangle, disparity, 8, 17, 34, 15, 6, 4, 1);
-			disparity.copyTo(disparity, mask);
+			//Compute the disparity of the masked pixels only
+			matcher.compute(DSFrame(left, right), mask, disparity, 8, 17, 34, 15, 6, 4, 1);
 
 			//Compute the mean disparity
 			mean = cv::mean(disparity, mask);